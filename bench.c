@@ -0,0 +1,183 @@
+#include "maze.h"
+
+// Benchmark suite, build with make bench.
+// Every generator and every solver stage is timed over a sweep of square grids,
+// with a monotonic clock, warmup runs and repeated trials. Results are reported
+// per benchmark and size as median and 99th percentile ns per cell and cells/s.
+
+#define BENCH_MIN_SIZE 8
+#define BENCH_MAX_SIZE 4096
+#define BENCH_WARMUP 1
+#define BENCH_MIN_TRIALS 5
+#define BENCH_MAX_TRIALS 1000
+#define BENCH_MIN_SECONDS 0.2 // keep repeating small grids until this much time was measured
+#define BENCH_SEED 1
+
+typedef struct Bench_options {
+	uint64_t min_size;
+	uint64_t max_size;
+	int min_trials;
+	int threads;
+	enum Page_mode pages;
+	bool first_touch;    // see --numa of maze
+	bool bands;          // see --bands of maze
+	bool parallel_solve; // see --parallel-solve of maze
+	bool json;
+	const char *only;    // run only the benchmark with this name
+} Bench_options;
+
+typedef struct Bench_result {
+	const char *name;
+	uint64_t size;
+	int trials;
+	double median_ns; // per cell
+	double p99_ns;    // per cell
+	const char *pages; // what the grid really got, see page_mode_name()
+} Bench_result;
+
+// Solver stages run on a maze generated once per size
+typedef enum Stage { DISTANCES, PATH, DEAD_ENDS, TEXT } Stage;
+static const char *Stage_names[] = { "calculate_distances", "path_to", "dead_ends", "to_string" };
+
+static double now_ns(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double*)a, y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// run_stage runs one trial of a benchmark and returns its time in ns. Generators
+// start from an empty maze, trial gives each its own seed.
+static double run_stage(Maze *m, const Algorithm *algorithm, Stage stage, int trial, FILE *sink) {
+	if(algorithm) {
+		clear_maze_links(m);
+		m->seed = BENCH_SEED + trial;
+		rng_seed(&m->rng, m->seed);
+		double start = now_ns();
+		generate_maze(m, algorithm->generate);
+		return now_ns() - start;
+	}
+	// the breadcrumbs of path_to are given back to the arena after every trial
+	Arena_mark mark = arena_mark(&m->arena);
+	double start = now_ns();
+	switch(stage) {
+		case DISTANCES: calculate_distances(m, 0); break;
+		case PATH: path_to(m, size(m)-1, m->distance[size(m)-1]); break;
+		case DEAD_ENDS: dead_ends(m); break;
+		case TEXT: to_string(m, sink, true); break;
+	}
+	double elapsed = now_ns() - start;
+	arena_release(&m->arena, mark);
+	return elapsed;
+
+}
+
+static Bench_result bench(Maze *m, const char *name, const Algorithm *algorithm, Stage stage, Bench_options *options, FILE *sink) {
+	for(int i=0; i<BENCH_WARMUP; i++) run_stage(m, algorithm, stage, -1 - i, sink);
+
+	double *times = (double*)malloc(BENCH_MAX_TRIALS * sizeof(double));
+	if(!times) die("Failed to allocate memory for trial times.", errno);
+	int trials = 0;
+	double total = 0;
+	while(trials < BENCH_MAX_TRIALS && (trials < options->min_trials || total < BENCH_MIN_SECONDS * 1e9)) {
+		times[trials] = run_stage(m, algorithm, stage, trials, sink);
+		total += times[trials++];
+	}
+	qsort(times, trials, sizeof(double), compare_double);
+	double cells = (double)size(m);
+	int p99 = MIN(trials - 1, (int)(trials * 0.99));
+	Bench_result result = {
+		.name = name,
+		.size = m->columns,
+		.trials = trials,
+		.median_ns = times[trials / 2] / cells,
+		.p99_ns = times[p99] / cells,
+		.pages = page_mode_name(&m->arena)
+	};
+	free(times);
+	return result;
+}
+
+static void report(Bench_result *result, Bench_options *options, bool first) {
+	uint64_t cells = result->size * result->size;
+	double cells_per_second = 1e9 / result->median_ns;
+	if(options->json) {
+		printf("%s\n  {\"benchmark\": \"%s\", \"columns\": %" PRIu64 ", \"rows\": %" PRIu64 ", \"cells\": %" PRIu64
+			", \"trials\": %d, \"median_ns_per_cell\": %.4f, \"p99_ns_per_cell\": %.4f, \"cells_per_second\": %.0f"
+			", \"threads\": %d, \"pages\": \"%s\", \"first_touch\": %s, \"bands\": %s, \"parallel_solve\": %s}",
+			first ? "" : ",", result->name, result->size, result->size, cells,
+			result->trials, result->median_ns, result->p99_ns, cells_per_second,
+			options->threads, result->pages, options->first_touch ? "true" : "false", options->bands ? "true" : "false", options->parallel_solve ? "true" : "false");
+	} else {
+		printf("%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%d,%.4f,%.4f,%.0f,%d,%s,%d,%d,%d\n",
+			result->name, result->size, result->size, cells,
+			result->trials, result->median_ns, result->p99_ns, cells_per_second,
+			options->threads, result->pages, options->first_touch, options->bands, options->parallel_solve);
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+	Bench_options options = {
+		.min_size = BENCH_MIN_SIZE,
+		.max_size = BENCH_MAX_SIZE,
+		.min_trials = BENCH_MIN_TRIALS,
+		.threads = 1
+	};
+	for(int i=1; i<argc; i++) {
+		if(strcmp(argv[i], "--json") == 0) options.json = true;
+		else if(strcmp(argv[i], "--csv") == 0) options.json = false;
+		else if(strcmp(argv[i], "--min-size") == 0 && i+1 < argc) options.min_size = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "--max-size") == 0 && i+1 < argc) options.max_size = strtoull(argv[++i], NULL, 10);
+		else if(strcmp(argv[i], "--trials") == 0 && i+1 < argc) options.min_trials = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--threads") == 0 && i+1 < argc) options.threads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--only") == 0 && i+1 < argc) options.only = argv[++i];
+		else if(strcmp(argv[i], "--huge-pages") == 0 && i+1 < argc) options.pages = page_mode(argv[++i]);
+		else if(strcmp(argv[i], "--numa") == 0) options.first_touch = true;
+		else if(strcmp(argv[i], "--bands") == 0) options.bands = true;
+		else if(strcmp(argv[i], "--parallel-solve") == 0) options.parallel_solve = true;
+		else die(" --csv report as csv (default)\n --json report as json\n --min-size N smallest grid side (default: 8)\n --max-size N largest grid side (default: 4096)\n --trials N minimum trials per benchmark (default: 5)\n --threads T worker threads (default: 1)\n --huge-pages MODE grids on huge pages, thp or hugetlb\n --numa first touch bands on the NUMA node of their thread\n --bands generate every algorithm in row bands on large grids\n --parallel-solve solve large grids in row bands on all threads\n --only NAME run one benchmark, a generator or solver stage name\n", EINVAL);
+	}
+	if(options.min_size < 2 || options.max_size < options.min_size) die("Error, invalid size range.", EINVAL);
+	if(options.min_trials < 1 || options.min_trials > BENCH_MAX_TRIALS) die("Error, invalid number of trials.", EINVAL);
+	if(options.threads < 1) die("Error, --threads needs a positive number.", EINVAL);
+
+	FILE *sink = fopen("/dev/null", "w");
+	if(!sink) die("Failed to open /dev/null.", errno);
+
+	if(options.json) printf("[");
+	else printf("benchmark,columns,rows,cells,trials,median_ns_per_cell,p99_ns_per_cell,cells_per_second,threads,pages,first_touch,bands,parallel_solve\n");
+	bool first = true;
+	for(uint64_t side=options.min_size; side<=options.max_size; side*=2) {
+		Maze maze = { .columns = side, .rows = side, .seed = BENCH_SEED, .threads = options.threads, .first_touch = options.first_touch, .bands = options.bands, .parallel_solve = options.parallel_solve };
+		maze.arena.pages = options.pages;
+		Maze *m = &maze;
+		initialize(m);
+		for(size_t i=0; i<Algorithms_count; i++) {
+			if(options.only && strcmp(options.only, Algorithms[i].name) != 0) continue;
+			Bench_result result = bench(m, Algorithms[i].name, &Algorithms[i], 0, &options, sink);
+			report(&result, &options, first);
+			first = false;
+		}
+		// the solver stages all work on the same maze
+		clear_maze_links(m);
+		rng_seed(&m->rng, BENCH_SEED);
+		generate_maze(m, &recursive_backtracker);
+		calculate_distances(m, 0);
+		for(Stage stage=DISTANCES; stage<=TEXT; stage++) {
+			if(options.only && strcmp(options.only, Stage_names[stage]) != 0) continue;
+			Bench_result result = bench(m, Stage_names[stage], NULL, stage, &options, sink);
+			report(&result, &options, first);
+			first = false;
+		}
+		free_all(m);
+		if(side > UINT64_MAX / 2) break;
+	}
+	if(options.json) printf("\n]\n");
+	fclose(sink);
+	return EXIT_SUCCESS;
+}
@@ -3,44 +3,117 @@
 #define COLS 8
 #define ROWS 8
 #define MAZE_DEBUG false
-#define LINKS_SIZE_STEP 4
 #define MAZE_TIGR
 #define DEAD_END 1
+#define STACK_MIN_CAPACITY 1024
+#define RENDER_BUFFER (1 << 20)
+#define ARENA_CHUNK (1 << 20) // smallest arena chunk, larger requests get a chunk of their own
+#define ARENA_ALIGN 64        // a cache line
+#define HUGE_PAGE_SIZE (2 << 20) // chunks this large are mapped when huge pages are asked for
+
+#define PARALLEL_BFS_CELLS (1 << 20) // smaller grids are solved serially
+#define PARALLEL_GEN_CELLS (1 << 22) // smaller grids are generated serially
+#define PARALLEL_GEN_BAND (1 << 18)  // cells per band of a parallel generated grid
+#define PARALLEL_GEN_MIN_ROWS 64     // thinner row bands would be little more than corridors
+#define PARALLEL_BFS_MIN_ROWS 64     // bands of the parallel solver are at least this high
+#define PARALLEL_BFS_BANDS 4         // bands per thread of the parallel solver, for balance
+#define BFS_UNLABELLED UINT32_MAX
 
 #define ANIMATION_SPEED 5
-#define WINDOW_WIDTH 128
-#define WINDOW_HEIGHT 128
-
-static int Columns = COLS;
-static int Rows = ROWS;
-
-static Cell **Grid;
-static Cell_node back_track_stack;
+#define LIVE_WINDOW_SIZE 1024 // the live view picks cells as large as fit this many pixels
+#define LIVE_CELL_SIZE 8
+#define DRAW_WIDTH 320
+#define DRAW_HEIGHT 240
+#define DRAW_MAX_CELL_SIZE 64
+#define DRAW_TEXT_CELL_SIZE 8 // smaller cells are drawn without distances
+#define DRAW_PAN_STEP 8       // pixels the view moves per frame an arrow key is held
+#define DRAW_IDLE_SLEEP 16000 // microseconds to sleep in frames without input
+#define IMAGE_CELL_SIZE 8
+
+// bit helpers for the packed wall sets
+#define BIT_WORD(i) ((i) >> 6)
+#define BIT_MASK(i) (1ULL << ((i) & 63))
+#define BIT_WORDS(n) (((n) + 63) >> 6)
+#define TEST_BIT(bits, i) (((bits)[BIT_WORD(i)] & BIT_MASK(i)) != 0)
+#define SET_BIT(bits, i) ((bits)[BIT_WORD(i)] |= BIT_MASK(i))
+#define CLEAR_BIT(bits, i) ((bits)[BIT_WORD(i)] &= ~BIT_MASK(i))
+
+const Algorithm Algorithms[] = {
+	{ "binary", &binary_tree_maze },
+	{ "sidewinder", &sidewinder_maze },
+	{ "aldous broder", &aldous_broder_maze },
+	{ "wilson", &wilson_maze },
+	{ "hunt and kill", &hunt_and_kill },
+	{ "recursive backtracker", &recursive_backtracker },
+	{ "eller", &eller_maze },
+};
+const size_t Algorithms_count = sizeof(Algorithms)/sizeof(Algorithms[0]);
+
+static const char *Page_mode_names[] = { "default", "thp", "hugetlb" };
+
+// page_mode returns the mode named name, see Page_mode_names
+enum Page_mode page_mode(const char *name) {
+	for(int i=0; i<(int)(sizeof(Page_mode_names)/sizeof(Page_mode_names[0])); i++)
+		if(strcmp(name, Page_mode_names[i]) == 0) return (enum Page_mode)i;
+	die("Error, --huge-pages needs thp or hugetlb.", EINVAL);
+	return PAGES_DEFAULT;
+}
 
-static bool Print_distances_flag = false;
-static bool Draw_maze_flag = false;
-static bool Print_path_flag = false;
-static bool Performance_test_flag = false;
-static bool Save_to_file_flag = false;
-static bool Draw_live_flag = false;
-static bool Print_dead_ends_flag = false;
+// page_mode_name returns the pages the arena's large chunks really got, reserved
+// huge pages fall back to transparent ones when there are none
+const char *page_mode_name(Arena *a) {
+	if(a->pages == PAGES_HUGETLB && a->hugetlb_fallback) return Page_mode_names[PAGES_TRANSPARENT];
+	return Page_mode_names[a->pages];
+}
 
-Tigr* Window;
+// algorithm_name returns the name generate is listed under in Algorithms
+const char *algorithm_name(void (*generate)(Maze *m)) {
+	for(size_t i=0; i<Algorithms_count; i++)
+		if(Algorithms[i].generate == generate) return Algorithms[i].name;
+	return "";
+}
 
+#ifndef MAZE_NO_MAIN // bench.c brings its own main
 int main(int argc, char *argv[]) {
 
-	void (*maze_algorithm)();
+	void (*maze_algorithm)(Maze *m);
 	maze_algorithm = &binary_tree_maze;
 
-	if(argc == 1) die(" -b use binary algorithm (default)\n -s use sidewinder algorithm\n -a use [a]ldous broder algorithm\n -w use [w]ilson algorithm\n -h use [h]unt and kill algorithm\n -r use [r]ecursive backtracker algorithm\n -d print [d]istances\n -i draw fancy [i]mage in window using tigr\n -p [p]rint path\n -t performance [t]est\n -o save maze image to [o]utput file\n", errno);
+	bool print_distances_flag = false;
+	bool draw_maze_flag = false;
+	bool print_path_flag = false;
+	bool performance_test_flag = false;
+	bool profile_flag = false;
+	bool print_dead_ends_flag = false;
+	bool stream_flag = false;
+	char *save_file = NULL;
+	char *image_file = NULL;
+	int image_cell_size = IMAGE_CELL_SIZE;
+	char *load_file = NULL;
+	char *stats_file = NULL;
+	FILE *stats_out = NULL;
+	bool endless_flag = false;
+	uint64_t batch_count = 0;
+	char *batch_output = NULL;
+
+	Maze maze = { .columns = COLS, .rows = ROWS };
+	Maze *m = &maze;
+
+	if(argc == 1) die(" -b use binary algorithm (default)\n -s use sidewinder algorithm\n -a use [a]ldous broder algorithm\n -w use [w]ilson algorithm\n -h use [h]unt and kill algorithm\n -r use [r]ecursive backtracker algorithm\n -e use [e]ller's algorithm\n -d print [d]istances\n -i draw fancy [i]mage in window using tigr\n -p [p]rint path\n -t performance [t]est\n -o save maze image to [o]utput file maze_image.png, no window needed\n --threads T number of worker threads (default: all cores)\n --seed S seed for the random generator, same seed gives the same maze\n --batch N generate N mazes on all worker threads\n --output FILE write the batch to FILE instead of stdout\n --stream print an eller maze row by row as it is generated, memory only grows with columns\n --endless stream eller rows forever\n --save FILE write the maze to a binary maze file, with distances if -d is given\n --load FILE read the maze from a binary maze file instead of generating one\n --image FILE save maze image to FILE, a .ppm or otherwise png\n --cell-size N pixels per cell in saved images (default: 8)\n --frame-budget MS draw live, showing one frame every MS milliseconds with as many steps as happened\n --profile run every algorithm with hardware counters and count allocations per helper\n --stats FILE write a json line per maze with phase times and memory use to FILE, - for stdout\n --huge-pages MODE back large grids with huge pages, thp (transparent) or hugetlb (reserved)\n --numa place each band of a parallel generated grid on the NUMA node of its thread\n --bands generate grids of 4M cells and more in row bands of at least 64 rows on all threads, joined by one link each, faster but not the algorithm's own maze. Binary and sidewinder grids that large are always cut into bands\n --parallel-solve solve grids of 1M cells and more in row bands on all threads\n"
+, errno);
+
+	m->threads = MAX((int)sysconf(_SC_NPROCESSORS_ONLN), 1);
+	m->seed = (uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32);
+
 	int arg_head = 1;
 	if(argc >= 3) {
-		int co = atoi(argv[arg_head]);
-		int ro = atoi(argv[arg_head+1]);
+		uint64_t co = strtoull(argv[arg_head], NULL, 10);
+		uint64_t ro = strtoull(argv[arg_head+1], NULL, 10);
 
 		if(co>1 && ro>1) {
-			Columns = co;
-			Rows = ro;
+			if(co > UINT64_MAX / ro) die("Maze size too large.", EOVERFLOW);
+			m->columns = co;
+			m->rows = ro;
 			arg_head += 2;
 		}
 	}
@@ -73,33 +146,84 @@ int main(int argc, char *argv[]) {
 					maze_algorithm = &recursive_backtracker;
 					break;
 
+				case 'e':
+					maze_algorithm = &eller_maze;
+					break;
+
 				case 'd':
-					Print_distances_flag = true;
+					print_distances_flag = true;
 					break;
 
 				case 'p':
-					Print_path_flag = true;
+					print_path_flag = true;
 					break;
 
 				case 'D':
-					Print_dead_ends_flag = true;
+					print_dead_ends_flag = true;
 					break;
 
 				case 't':
-					Performance_test_flag = true;
+					performance_test_flag = true;
 					break;
 
 				case 'i':
-					Draw_maze_flag = true;
+					draw_maze_flag = true;
 					break;
 
 				case 'o':
-					Draw_maze_flag = true;
-					Save_to_file_flag = true;
+					image_file = "./maze_image.png";
 					break;
 
 				case 'l':
-					Draw_live_flag = true;
+					m->draw_live = true;
+					break;
+
+				case '-':
+					if(strcmp(argument, "--threads") == 0 && arg_head+1 < argc) {
+						m->threads = atoi(argv[++arg_head]);
+						if(m->threads < 1) die("Error, --threads needs a positive number.", EINVAL);
+					} else if(strcmp(argument, "--seed") == 0 && arg_head+1 < argc) {
+						char *end_ptr;
+						m->seed = strtoull(argv[++arg_head], &end_ptr, 0);
+						if(*end_ptr != '\0') die("Error, --seed needs a number.", EINVAL);
+					} else if(strcmp(argument, "--batch") == 0 && arg_head+1 < argc) {
+						char *end_ptr;
+						batch_count = strtoull(argv[++arg_head], &end_ptr, 10);
+						if(*end_ptr != '\0' || batch_count == 0) die("Error, --batch needs a positive number.", EINVAL);
+					} else if(strcmp(argument, "--output") == 0 && arg_head+1 < argc) {
+						batch_output = argv[++arg_head];
+					} else if(strcmp(argument, "--save") == 0 && arg_head+1 < argc) {
+						save_file = argv[++arg_head];
+					} else if(strcmp(argument, "--load") == 0 && arg_head+1 < argc) {
+						load_file = argv[++arg_head];
+					} else if(strcmp(argument, "--image") == 0 && arg_head+1 < argc) {
+						image_file = argv[++arg_head];
+					} else if(strcmp(argument, "--cell-size") == 0 && arg_head+1 < argc) {
+						image_cell_size = atoi(argv[++arg_head]);
+						if(image_cell_size < 2) die("Error, --cell-size needs a number of at least 2.", EINVAL);
+					} else if(strcmp(argument, "--frame-budget") == 0 && arg_head+1 < argc) {
+						m->live.frame_budget_ms = atoi(argv[++arg_head]);
+						if(m->live.frame_budget_ms < 1) die("Error, --frame-budget needs a positive number of milliseconds.", EINVAL);
+						m->draw_live = true;
+					} else if(strcmp(argument, "--stream") == 0) {
+						stream_flag = true;
+					} else if(strcmp(argument, "--stats") == 0 && arg_head+1 < argc) {
+						stats_file = argv[++arg_head];
+					} else if(strcmp(argument, "--huge-pages") == 0 && arg_head+1 < argc) {
+						m->arena.pages = page_mode(argv[++arg_head]);
+					} else if(strcmp(argument, "--parallel-solve") == 0) {
+						m->parallel_solve = true;
+					} else if(strcmp(argument, "--bands") == 0) {
+						m->bands = true;
+					} else if(strcmp(argument, "--numa") == 0) {
+						m->first_touch = true;
+					} else if(strcmp(argument, "--profile") == 0) {
+						profile_flag = true;
+					} else if(strcmp(argument, "--endless") == 0) {
+						endless_flag = true;
+					} else {
+						die("Error, unknown argument.", errno);
+					}
 					break;
 
 				default:
@@ -111,283 +235,345 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	// create the maze
-	initialize();
+	if(stats_file) {
+		stats_out = strcmp(stats_file, "-") == 0 ? stdout : fopen(stats_file, "w");
+		if(!stats_out) die("Failed to open stats file.", errno);
+	}
+
+	if(stream_flag || endless_flag) {
+		stream_eller(m, stdout, endless_flag);
+		exit(EXIT_SUCCESS);
+	}
+
+	if(batch_count > 0) {
+		FILE *out = stdout;
+		if(batch_output && !(out = fopen(batch_output, "w"))) die("Failed to open batch output file.", errno);
+		batch_mazes(m, maze_algorithm, batch_count, out, print_distances_flag, stats_out);
+		if(out != stdout && fclose(out) != 0) die("Failed to write batch output file.", errno);
+		if(stats_out && stats_out != stdout && fclose(stats_out) != 0) die("Failed to write stats file.", errno);
+		exit(EXIT_SUCCESS);
+	}
 
-	srand(time(NULL));
-	(*maze_algorithm)();
+	// create the maze, or map it from a file
+	Maze_stats stats = { .algorithm = load_file ? "file" : algorithm_name(maze_algorithm) };
+	// phases the maze does not go through are left out, as in batch records
+	if(load_file) stats.skipped |= 1u << PHASE_GENERATE;
+	if(!save_file && !image_file) stats.skipped |= 1u << PHASE_EXPORT;
+	double phase = monotonic_ms();
+	bool loaded_distances = false;
+	if(load_file) {
+		loaded_distances = load_maze(m, load_file);
+		stats.ms[PHASE_INITIALIZE] = lap_ms(&phase);
+	} else {
+		initialize(m);
+		stats.ms[PHASE_INITIALIZE] = lap_ms(&phase);
+		generate_maze(m, maze_algorithm);
+		stats.ms[PHASE_GENERATE] = lap_ms(&phase);
+	}
 	
 	// solve the maze
-	Cell *max_distance_cell = calculate_distances(Grid[0]);
+	uint64_t max_distance_cell = loaded_distances ? furthest_cell(m) : calculate_distances(m, 0);
+	stats.ms[PHASE_DISTANCES] = lap_ms(&phase);
+
+	if(save_file) save_maze(m, save_file, algorithm_name(maze_algorithm), print_distances_flag);
+	stats.ms[PHASE_EXPORT] = lap_ms(&phase);
 
 	// get closest path from south east corner
-	// breadcrumbs is malloced – needs free()
-	Cell **breadcrumbs = path_to(max_distance_cell, max_distance_cell->distance);
+	// marks the path, its breadcrumbs stay in the maze's arena
+	path_to(m, max_distance_cell, m->distance[max_distance_cell]);
+	stats.ms[PHASE_PATH] = lap_ms(&phase);
 
-	if(Print_dead_ends_flag) printf("Dead ends: %d\n", dead_ends());
+	uint64_t dead_end_count = 0;
+	if(print_dead_ends_flag) printf("Dead ends: %" PRIu64 "\n", dead_end_count = dead_ends(m));
 
 	// print to terminal
-	size_t str_size = get_maze_string_size();
-	char maze_str[str_size];
-	to_string(maze_str, str_size, Print_distances_flag);
-	printf("%s", maze_str);
+	phase = monotonic_ms();
+	to_string(m, stdout, print_distances_flag);
+	stats.ms[PHASE_TO_STRING] = lap_ms(&phase);
+
+	// draw to window or image file
+	if(image_file) save_image(m, image_file, m->distance[max_distance_cell], image_cell_size);
+	stats.ms[PHASE_EXPORT] += lap_ms(&phase);
+
+	if(stats_out) {
+		// counted last, dead ends are marked in the text output
+		stats.max_distance = m->distance[max_distance_cell];
+		stats.dead_ends = print_dead_ends_flag ? dead_end_count : dead_ends(m);
+		write_stats(m, &stats, stats_out);
+		if(stats_out != stdout && fclose(stats_out) != 0) die("Failed to write stats file.", errno);
+	}
 
-	// draw to window
-	if(Draw_maze_flag) draw(Grid, breadcrumbs, max_distance_cell->distance);
+	if(draw_maze_flag) draw(m, m->distance[max_distance_cell]);
 
-	if(Print_distances_flag) 
-		printf("Max distance cell at column %d row %d, at distance %d steps.\n", 
-			max_distance_cell->column+1, 
-			max_distance_cell->row+1, 
-			max_distance_cell->distance);
+	if(print_distances_flag) 
+		printf("Max distance cell at column %" PRIu64 " row %" PRIu64 ", at distance %" PRIu32 " steps.\n", 
+			column(m, max_distance_cell)+1, 
+			row(m, max_distance_cell)+1, 
+			m->distance[max_distance_cell]);
 
 	
-	if(Performance_test_flag) {
+	if(performance_test_flag) {
 		int test_runs = 1000;
-		unsigned long binary_time = (unsigned long)performance_test(&binary_tree_maze, test_runs);
-		unsigned long sidewinder_time = (unsigned long)performance_test(&sidewinder_maze, test_runs);
-		unsigned long aldous_broder_time = (unsigned long)performance_test(&aldous_broder_maze, test_runs);
-		printf("    testing algorithms %d runs, size %d x %d\n    binary = %lu ms\n    sidewinder = %lu ms\n    aldous broder = %lu ms\n", test_runs, Columns, Rows, binary_time, sidewinder_time, aldous_broder_time);
+		printf("    testing algorithms %d runs, size %" PRIu64 " x %" PRIu64 "\n", test_runs, m->columns, m->rows);
+		for(size_t i=0; i<Algorithms_count; i++) {
+			double ms = performance_test(m, Algorithms[i].generate, test_runs);
+			double cells_per_second = (double)size(m) * test_runs / (ms / 1000.0);
+			printf("    %s = %.1f ms, %.0f cells/s\n", Algorithms[i].name, ms, cells_per_second);
+		}
 	}
+
+	if(profile_flag) profile_algorithms(m, stdout);
 	
 
 end:
 	// free and exit
-	free(breadcrumbs);
-	free_all();
-	draw_end();
+	draw_end(m);
+	free_all(m);
 	exit(EXIT_SUCCESS);
 }
+#endif
+
+// initialize takes the wall sets and the per cell arrays from the maze's arena.
+// Initializing a maze again resets the arena and reuses its chunks.
+void initialize(Maze *m) {
+	uint64_t cell_count = size(m);
+	arena_reset(&m->arena);
+	// left untouched here, clearing them is the first touch, see clear_maze_links()
+	m->east_links = (uint64_t*)arena_alloc(&m->arena, ALLOC_INITIALIZE, BIT_WORDS(cell_count) * sizeof(uint64_t));
+	m->south_links = (uint64_t*)arena_alloc(&m->arena, ALLOC_INITIALIZE, BIT_WORDS(cell_count) * sizeof(uint64_t));
+	m->marked = (uint64_t*)arena_alloc(&m->arena, ALLOC_INITIALIZE, BIT_WORDS(cell_count) * sizeof(uint64_t));
+	m->path = (uint64_t*)arena_alloc(&m->arena, ALLOC_INITIALIZE, BIT_WORDS(cell_count) * sizeof(uint64_t));
+	m->distance = (uint32_t*)arena_alloc(&m->arena, ALLOC_INITIALIZE, cell_count * sizeof(uint32_t));
+	clear_maze_links(m);
+	rng_seed(&m->rng, m->seed);
+}
+
+
+uint64_t cell(Maze *m, uint64_t column, uint64_t row) {
+	if(column >= m->columns) return NO_CELL;
+	if(row >= m->rows) return NO_CELL;
+	return index_at(m, column, row);
+}
+
+// neighbor returns the cell next to c in direction d, or NO_CELL at the grid edge
+uint64_t neighbor(Maze *m, uint64_t c, enum Direction d) {
+	switch(d) {
+		case NORTH: return (c >= m->columns) ? c - m->columns : NO_CELL;
+		case SOUTH: return (row(m, c) < m->rows-1) ? c + m->columns : NO_CELL;
+		case EAST:  return (column(m, c) < m->columns-1) ? c + 1 : NO_CELL;
+		case WEST:  return (column(m, c) > 0) ? c - 1 : NO_CELL;
+	}
+	return NO_CELL;
+}
+
+// step returns the cell next to c in direction d without checking the grid edges
+static inline uint64_t step(Maze *m, uint64_t c, enum Direction d) {
+	switch(d) {
+		case NORTH: return c - m->columns;
+		case SOUTH: return c + m->columns;
+		case EAST:  return c + 1;
+		case WEST:  return c - 1;
+	}
+	return NO_CELL;
+}
 
-// initialize allocate memory (malloc) for the array contaning the main grid of cells
-void initialize() {
-	int cell_count = size();
-	Grid = (Cell**)malloc(cell_count * sizeof(Cell*));
-	if(!Grid) die("Failed to allocate memory for grid cells!", errno);
-	for(int i=0; i<cell_count; i++) {
-		Grid[i] = (Cell*) malloc(sizeof(Cell));
-		if(!Grid[i]) die("Failed to allocate memory to cell.", errno);
-		init_cell(Grid[i], i % Columns, i / Columns);
-		if(MAZE_DEBUG) printf("cell %d: column: %d, row: %d\n", i, Grid[i]->column, Grid[i]->row);
-	}
-	configure_cells();
-}
-
-// init_cell allocate memory (calloc) for each cells links array
-void init_cell(Cell *c, int column, int row) {
-	c->column = column;
-	c->row = row;
-	c->links_size = LINKS_SIZE_STEP;
-	c->links = (Cell **)calloc(c->links_size, sizeof(Cell*));
-	if(!c->links) die("Failed to allocate memory to cell links array.", errno);
-	c->links_count = 0;
-	c->distance = 0;
-	c->marker = ' ';
-	c->solved = false;
-	c->junction = false;
-	c->path = false;
-}
-
-void configure_cells() {
-	if(!Grid) die("Grid not initilized.", errno);
-	int cell_count = size();
-	int neighbors = 0;
-	for(int i=0; i<cell_count; i++) {
-		Cell *c = Grid[i];
-		if(i>=Columns) c->north = Grid[i-Columns];
-		else c->north = NULL;
-		if(row(i)<Rows-1) c->south = Grid[i+Columns];
-		else c->south = NULL;
-		if(column(i)<Columns-1) c->east = Grid[i+1];
-		else c->east = NULL;
-		if(column(i)>0) c->west = Grid[i-1];
-		else c->west = NULL;
-	}
-}
-
-Cell *cell(int column, int row) {
-	if(column < 0 || column >= Columns) return NULL;
-	if(row < 0 || row >= Rows) return NULL;
-	return Grid[index_at(column, row)];
-}
-
-void link_cells(Cell *ca, Cell *cb, bool is_bidi) {
-	if(ca->links_count >= ca->links_size) {
-		ca->links_size = ca->links_size + LINKS_SIZE_STEP;
-		ca->links = (Cell **)realloc(ca->links, ca->links_size * sizeof(Cell*));
-		if(!ca->links) die("Failed to increase links array size!", errno);
-	}
-	if(!linked(ca,cb)) {
-		ca->links[ca->links_count] = cb;
-		ca->links_count++;
-	}
-	if(is_bidi) link_cells(cb, ca, false);
-}
-
-bool unlink_cells(Cell *ca, Cell *cb, bool is_bidi) {
-	bool is_found = false;
-	for(int i=0; i<ca->links_count; i++) {
-		if(!is_found)
-			if(ca->links[i] == cb) is_found = true;
-		if(is_found) 
-			ca->links[i] = ca->links[i+1];
-	}
-	if(is_found) ca->links_count--;
-	if(is_bidi) unlink_cells(cb, ca, false);
-	return is_found;
-}
-
-bool linked(Cell *ca, Cell *cb) {
-	if(ca && cb) return(find_link(ca,cb)>0);
+// direction_to returns the direction from ca to cb, or 0 if they are not neighbours
+static enum Direction direction_to(Maze *m, uint64_t ca, uint64_t cb) {
+	if(ca == NO_CELL || cb == NO_CELL) return 0;
+	if(cb == ca + m->columns) return (cb < size(m)) ? SOUTH : 0;
+	if(ca == cb + m->columns) return (ca < size(m)) ? NORTH : 0;
+	if(cb == ca + 1) return (column(m, ca) < m->columns-1) ? EAST : 0;
+	if(ca == cb + 1) return (column(m, cb) < m->columns-1) ? WEST : 0;
+	return 0;
+}
+
+// links returns the directions c is linked in. East and south are the cell's own bits,
+// west and north are the bits of the neighbour on that side, so each one is a bit test.
+// Cells on the east and south edges never get their own bit set, which keeps the
+// lookups free of column checks.
+uint8_t links(Maze *m, uint64_t c) {
+	uint8_t mask = 0;
+	if(c >= m->columns && TEST_BIT(m->south_links, c - m->columns)) mask |= NORTH;
+	if(TEST_BIT(m->south_links, c)) mask |= SOUTH;
+	if(TEST_BIT(m->east_links, c)) mask |= EAST;
+	if(c > 0 && TEST_BIT(m->east_links, c - 1)) mask |= WEST;
+	return mask;
+}
+
+bool linked_to(Maze *m, uint64_t c, enum Direction d) {
+	switch(d) {
+		case NORTH: return c >= m->columns && TEST_BIT(m->south_links, c - m->columns);
+		case SOUTH: return TEST_BIT(m->south_links, c);
+		case EAST:  return TEST_BIT(m->east_links, c);
+		case WEST:  return c > 0 && TEST_BIT(m->east_links, c - 1);
+	}
 	return false;
 }
 
-bool find_link(Cell *ca, Cell *cb) {
-	if(ca && cb) 
-		for(int i=0; i<ca->links_count; i++) 
-			if(ca->links[i] == cb) return true;
+// mark_dirty queues the tile of cell c to be redrawn with the next live frame
+static inline void mark_dirty(Maze *m, uint64_t c) {
+	if(c == NO_CELL || TEST_BIT(m->live.dirty, c)) return;
+	SET_BIT(m->live.dirty, c);
+	stack_push(&m->live.dirty_cells, c);
+}
+
+// link_direction links c to its neighbour in direction d. A tile draws all four of
+// its walls, so marking c is enough to show the new link live.
+void link_direction(Maze *m, uint64_t c, enum Direction d) {
+	if(m->live.dirty) mark_dirty(m, c);
+	switch(d) {
+		case NORTH: SET_BIT(m->south_links, c - m->columns); break;
+		case SOUTH: SET_BIT(m->south_links, c); break;
+		case EAST:  SET_BIT(m->east_links, c); break;
+		case WEST:  SET_BIT(m->east_links, c - 1); break;
+	}
+}
+
+void unlink_direction(Maze *m, uint64_t c, enum Direction d) {
+	switch(d) {
+		case NORTH: CLEAR_BIT(m->south_links, c - m->columns); break;
+		case SOUTH: CLEAR_BIT(m->south_links, c); break;
+		case EAST:  CLEAR_BIT(m->east_links, c); break;
+		case WEST:  CLEAR_BIT(m->east_links, c - 1); break;
+	}
+}
+
+void link_cells(Maze *m, uint64_t ca, uint64_t cb) {
+	enum Direction d = direction_to(m, ca, cb);
+	if(!d) die("Trying to link cells that are not neighbours.", EINVAL);
+	link_direction(m, ca, d);
+}
+
+bool unlink_cells(Maze *m, uint64_t ca, uint64_t cb) {
+	enum Direction d = direction_to(m, ca, cb);
+	if(!d || !linked_to(m, ca, d)) return false;
+	unlink_direction(m, ca, d);
+	return true;
+}
+
+bool linked(Maze *m, uint64_t ca, uint64_t cb) {
+	if(ca == NO_CELL || cb == NO_CELL) return false;
+	if(cb == ca + m->columns) return TEST_BIT(m->south_links, ca);
+	if(ca == cb + m->columns) return TEST_BIT(m->south_links, cb);
+	if(cb == ca + 1) return TEST_BIT(m->east_links, ca);
+	if(ca == cb + 1) return TEST_BIT(m->east_links, cb);
 	return false;
 }
 
-Cell** links(Cell *c) {
-	return c->links;
+int links_count(Maze *m, uint64_t c) {
+	return __builtin_popcount(links(m, c));
 }
 
-// warning: caller expected to free returned malloc array
-Cell **neighbors(Cell *c, int *counter) {
-	if(MAZE_DEBUG) 
-		printf("    Cell **neighbors(Cell *c)\n    Warning: Remember to free() return value.\n");
+// neighbors_mask returns the directions in which c has a neighbour
+uint8_t neighbors_mask(Maze *m, uint64_t c) {
+	uint8_t mask = 0;
+	if(c >= m->columns) mask |= NORTH;
+	if(c < size(m) - m->columns) mask |= SOUTH;
+	uint64_t col = column(m, c);
+	if(col < m->columns-1) mask |= EAST;
+	if(col > 0) mask |= WEST;
+	return mask;
+}
 
-	Cell **neighbors = (Cell**) calloc(4, sizeof(Cell*));
-	if(!neighbors) die("Failed allocating memory for neighbors array.", errno);
+// neighbors fills out with the neighbours of c and returns how many there are
+int neighbors(Maze *m, uint64_t c, uint64_t out[4]) {
 	int i=0;
-	if(c->north) neighbors[i++] = c->north;
-	if(c->south) neighbors[i++] = c->south;
-	if(c->east) neighbors[i++] = c->east;
-	if(c->west) neighbors[i++] = c->west;
-	*counter = i;
-	return neighbors;
-}
-
-// warning: caller expected to free returned malloc array
-Cell **neighbors_unlinked(Cell *c, int *counter) {
-	Cell **arr = (Cell**) calloc(4, sizeof(Cell*));
-	if(!arr) die("Failed allocating memory for neighbors array.", errno);
+	uint8_t mask = neighbors_mask(m, c);
+	for(enum Direction d=NORTH; d<=WEST; d<<=1)
+		if(mask & d) out[i++] = neighbor(m, c, d);
+	return i;
+}
+
+// neighbors_unlinked fills out with the neighbours c has no link to and returns how many there are
+int neighbors_unlinked(Maze *m, uint64_t c, uint64_t out[4]) {
 	int i=0;
-	if(c->north && !linked(c, c->north)) arr[i++] = c->north;
-	if(c->south && !linked(c, c->south)) arr[i++] = c->south;
-	if(c->east  && !linked(c, c->east)) arr[i++] = c->east;
-	if(c->west  && !linked(c, c->west)) arr[i++] = c->west;
-	*counter = i;
-	return arr;
+	uint8_t mask = neighbors_mask(m, c);
+	for(enum Direction d=NORTH; d<=WEST; d<<=1) {
+		if(!(mask & d)) continue;
+		if(!linked_to(m, c, d)) out[i++] = neighbor(m, c, d);
+	}
+	return i;
 }
 
-int neighbors_count(Cell *c) {
-	int n=0;
-	if(c->north) n++;
-	if(c->south) n++;
-	if(c->east) n++;
-	if(c->west) n++;
-	return n;
+int neighbors_count(Maze *m, uint64_t c) {
+	return __builtin_popcount(neighbors_mask(m, c));
 }
 
-Cell *get_random_neighbor(Cell *c) {
-	int counter;
-	Cell **neighbor_array = neighbors(c, &counter);
-	int rnd = rand() % counter;
-	Cell *random_neighbor = neighbor_array[rnd];
-	free(neighbor_array);
-	return random_neighbor;
+// random_direction_in picks one of the directions set in mask, mask must not be empty
+enum Direction random_direction_in(Maze *m, uint8_t mask) {
+	int k = rng_below(&m->rng, __builtin_popcount(mask));
+	while(k-- > 0) mask &= mask - 1; // drop the lowest set directions
+	return mask & -mask;
 }
 
-Cell *get_random_neighbor_without_link(Cell *c) {
-	int counter;
-	Cell **unlinked = neighbors_unlinked(c, &counter);
-	Cell *random_cell = NULL;
-	if(counter > 0) {
-		Cell *free_cells[counter];
-		for(int i=0; i<counter; i++) free_cells[i] = NULL;
-		int head = 0;
-		for(int i=0; i<counter; i++) {
-			if(unlinked[i]->links_count==0) free_cells[head++] = unlinked[i];
-		}
-		if(head>0) {
-			int rnd = random() % head;
-			random_cell = free_cells[rnd];
-		}
-	}
-	if(unlinked) free(unlinked);
-	return random_cell;
+uint64_t get_random_neighbor(Maze *m, uint64_t c) {
+	return neighbor(m, c, random_direction_in(m, neighbors_mask(m, c)));
+}
+
+// get_random_direction picks the direction of a random neighbour of c
+enum Direction get_random_direction(Maze *m, uint64_t c) {
+	return random_direction_in(m, neighbors_mask(m, c));
+}
+
+// get_random_neighbor_without_link picks a random neighbour that has no links at all yet
+uint64_t get_random_neighbor_without_link(Maze *m, uint64_t c) {
+	uint8_t mask = neighbors_mask(m, c);
+	uint8_t free_cells = 0;
+	for(enum Direction d=NORTH; d<=WEST; d<<=1)
+		if((mask & d) && links_count(m, neighbor(m, c, d))==0) free_cells |= d;
+	if(!free_cells) return NO_CELL;
+	return neighbor(m, c, random_direction_in(m, free_cells));
 }
 
 // ### algorithms
 
-// -b (default)
-void binary_tree_maze() {
-	int cell_count = size();
-	if(Draw_live_flag) draw_start();
-	for(int i=0; i<cell_count; i++) {
-		Cell *c = Grid[i];
-		int j = 0;
-		Cell *neighbors[2];
-		for(int n=0;n<2;n++) neighbors[n] = NULL;
-		if(c->north) neighbors[j++] = c->north;
-		if(c->east) neighbors[j++] = c->east;
-		if(j==0) continue;
-		//srand(time(NULL));
-		int rnd = rand() % j;
-		Cell *neighbor = neighbors[rnd];
-		link_cells(c, neighbor, true);
-		if(Draw_live_flag) draw_update(ANIMATION_SPEED, NULL);
+// replay_links shows a maze that was generated without drawing: its links are
+// taken out and put back cell by cell, a frame for the north and west links of each
+// cell. Binary tree and sidewinder use it so -l shows the maze the seed gives.
+void replay_links(Maze *m) {
+	uint64_t cell_count = size(m);
+	size_t bytes = BIT_WORDS(cell_count) * sizeof(uint64_t);
+	Arena_mark mark = arena_mark(&m->arena);
+	uint64_t *east = (uint64_t*)arena_alloc(&m->arena, ALLOC_GENERATOR, bytes);
+	uint64_t *south = (uint64_t*)arena_alloc(&m->arena, ALLOC_GENERATOR, bytes);
+	memcpy(east, m->east_links, bytes);
+	memcpy(south, m->south_links, bytes);
+	memset(m->east_links, 0, bytes);
+	memset(m->south_links, 0, bytes);
+	draw_start(m);
+	for(uint64_t i=0; i<cell_count; i++) {
+		bool north = i >= m->columns && TEST_BIT(south, i - m->columns);
+		bool west = column(m, i) > 0 && TEST_BIT(east, i - 1);
+		if(north) link_direction(m, i, NORTH);
+		if(west) link_direction(m, i, WEST);
+		if(north || west) draw_update(m, ANIMATION_SPEED, NO_CELL);
 	}
+	arena_release(&m->arena, mark);
 }
 
-// -s
-void sidewinder_maze() { 
-	if(Draw_live_flag) draw_start();
-	for(int ro=0; ro<Rows; ro++) {
-		Cell *corridor[Columns];
-		int index=0;
-		for(int co=0; co<Columns; co++) {
-			Cell *c = cell(co, ro);
-			corridor[index] = c;
-			if(!c) continue;
-			index++;
-			bool at_eastern_boundary = (c->east == NULL);
-			bool at_northern_boundary = (c->north == NULL);
-			int rnd = rand() % 2; // random number between 0 and 1:
-			bool should_close_out = at_eastern_boundary || (!at_northern_boundary && rnd==0);
-			if(should_close_out) {
-				int rnd_index = rand() % index;
-				Cell *member = corridor[rnd_index];
-				if(member->north) link_cells(member, member->north, true);
-				while(index > 0) {
-					index--;
-					corridor[index] = NULL;
-				}
-			} else {
-				link_cells(c, c->east, true);
-				if(Draw_live_flag) draw_update(ANIMATION_SPEED, NULL);
-			}
-		}
-	}
+// -b (default)
+void binary_tree_maze(Maze *m) {
+	binary_tree_band(m, &m->rng, 0, size(m));
+	if(m->draw_live) replay_links(m);
 }
 
 // -s
-void aldous_broder_maze() { 
-	Cell *c = random_cell_from_grid(NULL);
-	int cell_count = size();
-	int unvisited = cell_count -1;
-	if(Draw_live_flag) draw_start();
+void sidewinder_maze(Maze *m) {
+	sidewinder_band(m, &m->rng, 0, size(m));
+	if(m->draw_live) replay_links(m);
+}
+
+// -a
+void aldous_broder_maze(Maze *m) {
+	uint64_t c = random_cell_from_grid(m, NULL);
+	uint64_t cell_count = size(m);
+	uint64_t unvisited = cell_count -1;
+	if(m->draw_live) draw_start(m);
 	while(unvisited > 0) {
-		int counter;
-		Cell **neighbor_array = neighbors(c, &counter); 
-		int rnd = random() % counter;
-		Cell *n = neighbor_array[rnd];
-		free(neighbor_array);
-		if(n->links_count==0) {
-			link_cells(c,n, true);
-			if(Draw_live_flag) draw_update(ANIMATION_SPEED, NULL);
+		uint64_t n = get_random_neighbor(m, c);
+		if(links_count(m, n)==0) {
+			link_cells(m, c, n);
+			if(m->draw_live) draw_update(m, ANIMATION_SPEED, NO_CELL);
 			unvisited -= 1;
 		}
 		c = n;
@@ -395,88 +581,103 @@ void aldous_broder_maze() {
 }
 
 // -w
-void wilson_maze() { 
-	int cell_count = size();
-	int unvisited_length = cell_count;
-	Cell *unvisited[unvisited_length];
-	for(int c=0; c<unvisited_length; c++) unvisited[c] = Grid[c];
-	int cell_index;
-	Cell *first = random_cell_from_array(unvisited, unvisited_length, &cell_index);
-	unvisited_length = remove_cell_from_array(unvisited, cell_index, unvisited_length);
-	if(Draw_live_flag) draw_start();
-
-	while(unvisited_length>0) {	
-		Cell *cell = random_cell_from_array(unvisited, unvisited_length, &cell_index);
-		Cell *path[cell_count];
-		for(int i=0; i<cell_count; i++) path[i] = NULL;
-		int path_length = 0;
-		path[0] = cell;
-		path_length++;
-
-		while(array_includes_cell(unvisited, cell, unvisited_length, NULL)) {
-			cell = get_random_neighbor(cell);
-			int position;
-			array_includes_cell(path, cell, path_length, &position);
-			if(position >= 0) {
-				path_length = position+1;
-			} else {
-				path[path_length] = cell;
-				path_length++;
-			}
+// Loop erased random walks: the walk stores the direction it last left each cell in,
+// walking into the path again just overwrites it, which erases the loop. Retracing
+// the directions from the start then carves the loop free path.
+void wilson_maze(Maze *m) {
+	uint64_t cell_count = size(m);
+	Arena_mark mark = arena_mark(&m->arena);
+	uint64_t *visited = (uint64_t*)arena_calloc(&m->arena, ALLOC_GENERATOR, BIT_WORDS(cell_count), sizeof(uint64_t));
+	uint64_t *unvisited = (uint64_t*)arena_alloc(&m->arena, ALLOC_GENERATOR, cell_count * sizeof(uint64_t)); // unordered
+	uint64_t *slot = (uint64_t*)arena_alloc(&m->arena, ALLOC_GENERATOR, cell_count * sizeof(uint64_t));      // cell's position in unvisited
+	uint8_t *next_direction = (uint8_t*)arena_alloc(&m->arena, ALLOC_GENERATOR, cell_count * sizeof(uint8_t));
+	for(uint64_t c=0; c<cell_count; c++) {
+		unvisited[c] = c;
+		slot[c] = c;
+	}
+	uint64_t unvisited_length = cell_count;
+
+	uint64_t first = random_cell_from_array(m, unvisited, unvisited_length, NULL);
+	SET_BIT(visited, first);
+	unvisited_length = remove_unvisited(unvisited, slot, unvisited_length, first);
+	if(m->draw_live) draw_start(m);
+
+	while(unvisited_length>0) {
+		uint64_t start = random_cell_from_array(m, unvisited, unvisited_length, NULL);
+		uint64_t cell = start;
+		while(!TEST_BIT(visited, cell)) {
+			enum Direction d = get_random_direction(m, cell);
+			next_direction[cell] = d;
+			cell = neighbor(m, cell, d);
 		}
 
-		for(int i=0; i<path_length-1; i++) {
-			link_cells(path[i], path[i+1], true);
-			if(Draw_live_flag) draw_update(ANIMATION_SPEED, NULL);
-			int index;
-			array_includes_cell(unvisited, path[i], unvisited_length, &index);
-			if(index >= 0) unvisited_length = remove_cell_from_array(unvisited, index, unvisited_length);
+		cell = start;
+		while(!TEST_BIT(visited, cell)) {
+			uint64_t next = step(m, cell, next_direction[cell]);
+			link_direction(m, cell, next_direction[cell]);
+			if(m->draw_live) draw_update(m, ANIMATION_SPEED, NO_CELL);
+			SET_BIT(visited, cell);
+			unvisited_length = remove_unvisited(unvisited, slot, unvisited_length, cell);
+			cell = next;
 		}
 	}
+	arena_release(&m->arena, mark);
 }
 
 // -h
-void hunt_and_kill() {
+// No cell before hunt_cursor is an unvisited cell with a visited neighbour, so a hunt
+// resumes where the last one stopped instead of rescanning the grid, skipping whole
+// words of visited cells in the bitset at a time. Visiting a cell can only turn its
+// own neighbours into hunt targets, so each visit pulls the cursor back to at most
+// the neighbour above it.
+void hunt_and_kill(Maze *m) {
 	enum MODE {kill, hunt};
 	enum MODE mode = kill;
 
-	int cell_count = size();
-	Cell *c = random_cell_from_grid(NULL);
-	int unvisited = cell_count-1;
-	bool kill_mode = true;
-	
+	uint64_t cell_count = size(m);
+	Arena_mark mark = arena_mark(&m->arena);
+	uint64_t *visited = (uint64_t*)arena_calloc(&m->arena, ALLOC_GENERATOR, BIT_WORDS(cell_count), sizeof(uint64_t));
+	uint64_t hunt_cursor = 0;
+	uint64_t c = random_cell_from_grid(m, NULL);
+	SET_BIT(visited, c);
+	hunt_cursor = (c >= m->columns) ? c - m->columns : 0;
+	uint64_t unvisited = cell_count-1;
+	if(m->draw_live) draw_start(m);
+
 	while(unvisited > 0) {
 		switch(mode) {
 			case kill: {
-				Cell *l = NULL;
-				l = get_random_neighbor_without_link(c);
-				if(!l) {
+				uint8_t mask = neighbors_mask(m, c);
+				uint8_t free_cells = 0;
+				for(enum Direction d=NORTH; d<=WEST; d<<=1)
+					if((mask & d) && !TEST_BIT(visited, step(m, c, d))) free_cells |= d;
+				if(!free_cells) {
 					mode = hunt;
 				} else {
-					link_cells(c, l, true);
+					enum Direction d = random_direction_in(m, free_cells);
+					link_direction(m, c, d);
+					c = step(m, c, d);
+					SET_BIT(visited, c);
+					hunt_cursor = MIN(hunt_cursor, (c >= m->columns) ? c - m->columns : 0);
 					unvisited--;
-					c = l;
+					if(m->draw_live) draw_update(m, ANIMATION_SPEED, c);
 				}
 				break;
 			}
 			case hunt: {
-				for(int i=0; i<cell_count; i++) {
-					c = Grid[i];
-					if(c->links_count > 0) continue;
-					int cnt;
-					Cell **arr = neighbors(c, &cnt);
-					Cell *arr_lnk[cnt];
-					int head = 0;
-					for(int j=0; j<cnt; j++) {
-						if(arr[j]->links_count>0) arr_lnk[head++] = arr[j];					
-					}
-					if(arr) free(arr);
-					if(head>0){
-						int rnd = random() % head;
-						link_cells(c, arr_lnk[rnd], true);
-						c = arr_lnk[rnd];
+				for(uint64_t i=first_clear_bit(visited, hunt_cursor, cell_count); i<cell_count; i=first_clear_bit(visited, i+1, cell_count)) {
+					uint8_t mask = neighbors_mask(m, i);
+					uint8_t visited_neighbors = 0;
+					for(enum Direction d=NORTH; d<=WEST; d<<=1)
+						if((mask & d) && TEST_BIT(visited, step(m, i, d))) visited_neighbors |= d;
+					if(visited_neighbors) {
+						link_direction(m, i, random_direction_in(m, visited_neighbors));
+						SET_BIT(visited, i);
+						hunt_cursor = (i >= m->columns) ? i - m->columns : 0;
+						c = i;
 						unvisited--;
 						mode = kill;
+						if(m->draw_live) draw_update(m, ANIMATION_SPEED, c);
 						break;
 					}
 				}
@@ -484,54 +685,152 @@ void hunt_and_kill() {
 			}
 		}
 	}
+	arena_release(&m->arena, mark);
 }
 
-void recursive_backtracker() {
-	enum MODE {forward, backtrack};
-	enum MODE mode = forward;
-
-	Stack_control *stack = NULL;
-	Cell *current_cell = random_cell_from_grid(NULL);
-	push_stack(&stack, current_cell);
-
-	if(Draw_live_flag) {
-		draw_start();
-		draw_update(ANIMATION_SPEED, current_cell);
+// -r
+// The stack holds the current corridor, the top is the cell being carved from.
+// Cells are visited once they are pushed, so the choice of unvisited neighbours
+// is a bit test per direction.
+void recursive_backtracker(Maze *m) {
+	uint64_t cell_count = size(m);
+	Arena_mark mark = arena_mark(&m->arena);
+	uint64_t *visited = (uint64_t*)arena_calloc(&m->arena, ALLOC_GENERATOR, BIT_WORDS(cell_count), sizeof(uint64_t));
+	Cell_stack stack = { .arena = &m->arena };
+
+	uint64_t current_cell = random_cell_from_grid(m, NULL);
+	SET_BIT(visited, current_cell);
+	stack_push(&stack, current_cell);
+
+	if(m->draw_live) {
+		draw_start(m);
+		draw_update(m, ANIMATION_SPEED, current_cell);
 	}
-	
-	while(stack != NULL) {
-		Cell *next_cell = get_random_neighbor_without_link(current_cell);
-		if(next_cell) {
-			if(current_cell->junction) push_stack(&stack, current_cell);
-			link_cells(current_cell, next_cell, true);
-			push_stack(&stack, next_cell);
+
+	while(stack.count > 0) {
+		current_cell = stack.cells[stack.count-1];
+		uint8_t mask = neighbors_mask(m, current_cell);
+		uint8_t unvisited = 0;
+		for(enum Direction d=NORTH; d<=WEST; d<<=1)
+			if((mask & d) && !TEST_BIT(visited, step(m, current_cell, d))) unvisited |= d;
+		if(unvisited) {
+			enum Direction d = random_direction_in(m, unvisited);
+			uint64_t next_cell = step(m, current_cell, d);
+			link_direction(m, current_cell, d);
+			SET_BIT(visited, next_cell);
+			stack_push(&stack, next_cell);
 			current_cell = next_cell;
 		} else {
-			current_cell = pop_stack(&stack);
-			if(current_cell->links_count>=2) current_cell->junction = true;			
-		}	
-		if(Draw_live_flag) draw_update(ANIMATION_SPEED, current_cell);	
+			stack_pop(&stack);
+		}
+		if(m->draw_live) draw_update(m, ANIMATION_SPEED, current_cell);
 	}
+	arena_release(&m->arena, mark);
 }
 
-void push_stack(Stack_control **stack, void *data) {
-	Stack_control *temp = malloc(sizeof(Stack_control));
-	temp->data = data;
-	temp->next = *stack;
-	*stack = temp;
+// -e
+// Eller's algorithm builds the maze a row at a time and only remembers which set
+// each cell of the current row belongs to, see eller_row().
+void eller_maze(Maze *m) {
+	if(m->draw_live) draw_start(m);
+	Arena_mark mark = arena_mark(&m->arena);
+	Eller eller;
+	eller_start(&eller, &m->arena, m->columns);
+	for(uint64_t ro=0; ro<m->rows; ro++) {
+		eller_row(&eller, &m->rng, ro == m->rows-1);
+		uint64_t first = ro * m->columns;
+		for(uint64_t w=0; w<BIT_WORDS(m->columns); w++) {
+			for(uint64_t bits=eller.east[w]; bits; bits&=bits-1) link_direction(m, first + (w << 6) + __builtin_ctzll(bits), EAST);
+			for(uint64_t bits=eller.south[w]; bits; bits&=bits-1) link_direction(m, first + (w << 6) + __builtin_ctzll(bits), SOUTH);
+		}
+		if(m->draw_live) draw_update(m, ANIMATION_SPEED, NO_CELL);
+	}
+	arena_release(&m->arena, mark);
 }
 
-void *pop_stack(Stack_control **stack) {
-	void *data = NULL;
-	Stack_control *temp = *stack;
-	if(temp) {
-		data = temp->data;
-		*stack = temp->next;
-		free(temp);
+// eller_start takes the row state from arena, every array holds one entry per column
+void eller_start(Eller *eller, Arena *arena, uint64_t columns) {
+	eller->columns = columns;
+	eller->set = (uint64_t*)arena_alloc(arena, ALLOC_ELLER, columns * sizeof(uint64_t));
+	eller->parent = (uint64_t*)arena_alloc(arena, ALLOC_ELLER, columns * sizeof(uint64_t));
+	eller->members = (uint64_t*)arena_alloc(arena, ALLOC_ELLER, columns * sizeof(uint64_t));
+	eller->east = (uint64_t*)arena_calloc(arena, ALLOC_ELLER, BIT_WORDS(columns), sizeof(uint64_t));
+	eller->south = (uint64_t*)arena_calloc(arena, ALLOC_ELLER, BIT_WORDS(columns), sizeof(uint64_t));
+	// the first row starts with every cell in a set of its own
+	for(uint64_t co=0; co<columns; co++) eller->set[co] = co;
+}
+
+static uint64_t eller_find(Eller *eller, uint64_t s) {
+	while(eller->parent[s] != s) s = eller->parent[s] = eller->parent[eller->parent[s]];
+	return s;
+}
+
+// eller_row links the current row and moves the sets on to the next one. Cells
+// of different sets are joined east at random, on the last row always. Then every
+// set links south at random but at least once, the cells below a south link stay
+// in its set and all others start a set of their own. Sets are renumbered to stay
+// below columns, so the state never grows with the number of rows.
+void eller_row(Eller *eller, Rng *rng, bool last_row) {
+	uint64_t columns = eller->columns;
+	memset(eller->east, 0, BIT_WORDS(columns) * sizeof(uint64_t));
+	memset(eller->south, 0, BIT_WORDS(columns) * sizeof(uint64_t));
+	for(uint64_t s=0; s<columns; s++) eller->parent[s] = s;
+
+	for(uint64_t co=0; co+1<columns; co++) {
+		uint64_t a = eller_find(eller, eller->set[co]);
+		uint64_t b = eller_find(eller, eller->set[co+1]);
+		if(a == b || !(last_row || (rng_next(rng) >> 63))) continue;
+		SET_BIT(eller->east, co);
+		eller->parent[b] = a;
+	}
+	for(uint64_t co=0; co<columns; co++) eller->set[co] = eller_find(eller, eller->set[co]);
+	if(last_row) return;
+
+	// members counts the cells of each set, and is cleared once a set links south
+	memset(eller->members, 0, columns * sizeof(uint64_t));
+	for(uint64_t co=0; co<columns; co++) eller->members[eller->set[co]]++;
+	for(uint64_t co=0; co<columns; co++) {
+		if(rng_next(rng) >> 63) {
+			SET_BIT(eller->south, co);
+			eller->members[eller->set[co]] = 0;
+		}
+	}
+	// sets that did not link south pick one random member, members becomes the countdown
+	for(uint64_t s=0; s<columns; s++)
+		if(eller->members[s]) eller->members[s] = rng_below(rng, eller->members[s]) + 1;
+	for(uint64_t co=0; co<columns; co++) {
+		uint64_t s = eller->set[co];
+		if(eller->members[s] && --eller->members[s] == 0) SET_BIT(eller->south, co);
+	}
+
+	// renumber, parent now maps old sets to new ones
+	for(uint64_t s=0; s<columns; s++) eller->parent[s] = NO_CELL;
+	uint64_t sets = 0;
+	for(uint64_t co=0; co<columns; co++) {
+		uint64_t s = eller->set[co];
+		if(!TEST_BIT(eller->south, co)) eller->set[co] = sets++;
+		else if(eller->parent[s] == NO_CELL) eller->set[co] = eller->parent[s] = sets++;
+		else eller->set[co] = eller->parent[s];
 	}
-	return data;
 }
 
+// stack_push grows the stack by doubling in its arena, so pushes are amortized O(1).
+// The outgrown cells stay behind in the arena, at most as much as the stack holds.
+void stack_push(Cell_stack *stack, uint64_t c) {
+	if(stack->count == stack->capacity) {
+		uint64_t capacity = MAX(stack->capacity * 2, STACK_MIN_CAPACITY);
+		uint64_t *cells = (uint64_t*)arena_alloc(stack->arena, ALLOC_STACK, capacity * sizeof(uint64_t));
+		if(stack->count) memcpy(cells, stack->cells, stack->count * sizeof(uint64_t));
+		stack->cells = cells;
+		stack->capacity = capacity;
+	}
+	stack->cells[stack->count++] = c;
+}
+
+uint64_t stack_pop(Cell_stack *stack) {
+	if(stack->count == 0) return NO_CELL;
+	return stack->cells[--stack->count];
+}
 
 
 
@@ -539,65 +838,770 @@ void *pop_stack(Stack_control **stack) {
 
 
 
-bool array_includes_cell(Cell *arr[], Cell *c, int arr_len, int *index) {
-	for(int i=0; i<arr_len; i++) {
-		if(arr[i] == c) {
-			if(index) *index = i;
-			return true;
+// first_clear_bit returns the first index at or after from whose bit is clear, or n if there is none
+uint64_t first_clear_bit(const uint64_t *bits, uint64_t from, uint64_t n) {
+	if(from >= n) return n;
+	uint64_t w = BIT_WORD(from);
+	uint64_t word = ~bits[w] & (~0ULL << (from & 63));
+	while(!word) {
+		if(++w >= BIT_WORDS(n)) return n;
+		word = ~bits[w];
+	}
+	return MIN((w << 6) + __builtin_ctzll(word), n);
+}
+
+// remove_unvisited swaps the last unvisited cell into c's position, slot tracks where each cell is
+uint64_t remove_unvisited(uint64_t *unvisited, uint64_t *slot, uint64_t length, uint64_t c) {
+	uint64_t last = unvisited[length-1];
+	unvisited[slot[c]] = last;
+	slot[last] = slot[c];
+	return length-1;
+}
+
+// calculate_distances runs a breadth first search from root, every cell is
+// queued exactly once so the queue is allocated once with room for the whole grid.
+// With m->parallel_solve large grids are handed to the parallel solver, it leaves
+// mazes that are not trees to this one. Cells are queued as 64-bit indices, only a
+// path as long as NO_DISTANCE is refused.
+uint64_t calculate_distances(Maze *m, uint64_t root) {
+	uint64_t cell_count = size(m);
+	if(m->parallel_solve && m->threads > 1 && cell_count >= PARALLEL_BFS_CELLS) {
+		uint64_t furthest = calculate_distances_parallel(m, root);
+		if(furthest != NO_CELL) return furthest;
+	}
+	Arena_mark mark = arena_mark(&m->arena);
+	uint64_t *queue = (uint64_t*)arena_alloc(&m->arena, ALLOC_DISTANCES, cell_count * sizeof(uint64_t));
+	memset(m->distance, 0xff, cell_count * sizeof(uint32_t));
+
+	uint64_t head = 0;
+	uint64_t tail = 0;
+	queue[tail++] = root;
+	m->distance[root] = 0;
+	while(head < tail) {
+		uint64_t cell = queue[head++];
+		uint32_t next_distance = m->distance[cell] + 1;
+		if(next_distance == NO_DISTANCE) die("Maze too large for calculating distances.", EOVERFLOW);
+		uint8_t l = links(m, cell);
+		for(enum Direction d=NORTH; d<=WEST; d<<=1) {
+			if(!(l & d)) continue;
+			uint64_t n = step(m, cell, d);
+			if(m->distance[n] != NO_DISTANCE) continue; // already solved
+			m->distance[n] = next_distance;
+			queue[tail++] = n;
 		}
 	}
-	if(index) *index = -1;
-	return false;
+	// cells are queued in order of distance, the furthest level is at the end of the queue,
+	// of its cells the lowest index is picked so every solver agrees on the result
+	uint64_t max_distance_cell = queue[tail-1];
+	uint32_t max_distance = m->distance[max_distance_cell];
+	for(uint64_t i=tail; i>0 && m->distance[queue[i-1]] == max_distance; i--)
+		max_distance_cell = MIN(max_distance_cell, queue[i-1]);
+	arena_release(&m->arena, mark);
+	return max_distance_cell;
 }
 
-int remove_cell_from_array(Cell *arr[], int cell_index, int length) {
-	for(int i=cell_index; i<length; i++) {
-		if(i==length-1) arr[i]=NULL;
-		else arr[i]=arr[i+1];
-	}
-	length--;
-	return length;
-}
-
-Cell *calculate_distances(Cell *root) {
-	int max_cells = 64;
-	Cell *front[max_cells];
-	front[0] = root;
-	int front_count = 1; // counting root as #1
-	root->solved = true;
-	Cell *max_distance_cell = root;
-	while(front_count>0){
-		if(front_count>max_cells) die("Maze too large for calculating distances.", errno);
-		Cell *new_front[max_cells];
-		int new_front_count = 0;
-
-		for(int i=0; i<front_count; i++) {
-			Cell *cell = front[i];
-			for(int j=0; j<cell->links_count; j++) {
-				Cell *linked = cell->links[j];
-				if(linked->solved) continue; // if distance more than 0 skip
-				linked->distance = cell->distance + 1;
-				if(linked->distance > max_distance_cell->distance) 
-					max_distance_cell = linked;
-				linked->solved = true;
-				new_front[new_front_count] = linked;
-				new_front_count++;
+// ### word kernels
+
+// Binary tree and sidewinder decide every cell with one random bit, so they are
+// generated a bitset word at a time: 64 cells get their random bits, edge masks
+// and links with a handful of word operations instead of a call per cell.
+
+// Word_masks tracks which cells of the current word have a northern and an
+// eastern neighbour, edge is the next cell in the eastern column.
+typedef struct Word_masks {
+	uint64_t valid; // cells of the word inside the range
+	uint64_t north; // cells below the top row
+	uint64_t east;  // cells left of the eastern column
+	uint64_t edge;
+} Word_masks;
+
+static inline void word_masks(Maze *m, Word_masks *masks, uint64_t first, uint64_t to) {
+	masks->valid = (to - first >= 64) ? ~0ULL : BIT_MASK(to - first) - 1;
+	if(first >= m->columns) masks->north = ~0ULL;
+	else masks->north = (m->columns - first >= 64) ? 0 : ~(BIT_MASK(m->columns - first) - 1);
+	masks->east = ~0ULL;
+	for( ; masks->edge < first + 64; masks->edge += m->columns) masks->east &= ~BIT_MASK(masks->edge - first);
+}
+
+// set_north_links sets the north links of the cells in word, bit i standing for
+// cell first + i, by setting the south bits of the cells a row up
+static inline void set_north_links(Maze *m, uint64_t first, uint64_t word) {
+	if(!word) return;
+	if(first < m->columns) {
+		m->south_links[0] |= word >> (m->columns - first);
+		return;
+	}
+	uint64_t start = first - m->columns;
+	uint64_t w = BIT_WORD(start);
+	int b = start & 63;
+	m->south_links[w] |= word << b;
+	if(b && (word >> (64 - b))) m->south_links[w+1] |= word >> (64 - b);
+}
+
+// rng_lanes_seed seeds the four lanes from four draws of r
+static void rng_lanes_seed(Rng_lanes *lanes, Rng *r) {
+	for(int lane=0; lane<4; lane++) {
+		Rng one;
+		rng_seed(&one, rng_next(r));
+		for(int i=0; i<4; i++) lanes->s[i][lane] = one.s[i];
+	}
+}
+
+// rng_lanes_next steps all four lanes at once, giving 256 random bits
+static inline void rng_lanes_next(Rng_lanes *lanes, Rng_vector *out) {
+	Rng_vector *s = lanes->s;
+	Rng_vector x = s[1] * 5;
+	Rng_vector result = ((x << 7) | (x >> 57)) * 9;
+	Rng_vector t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = (s[3] << 45) | (s[3] >> 19);
+	*out = result;
+}
+
+// Random_bits hands out 64 random bits at a time from a four lane xoshiro256**
+typedef struct Random_bits {
+	Rng_lanes lanes;
+	Rng_vector block;
+	int left;
+	uint64_t halves; // a word handed out 32 bits at a time
+	int halves_left;
+} Random_bits;
+
+static inline uint64_t next_random_word(Random_bits *bits) {
+	if(bits->left == 0) {
+		rng_lanes_next(&bits->lanes, &bits->block);
+		bits->left = 4;
+	}
+	return bits->block[--bits->left];
+}
+
+// next_random_below returns an unbiased random number in [0, n) for a run length n,
+// from 32 random bits with Lemire's multiply and reject like rng_below()
+static inline uint64_t next_random_below(Random_bits *bits, Rng *rng, uint64_t n) {
+	if(n > UINT32_MAX) return rng_below(rng, n);
+	if(bits->halves_left == 0) {
+		bits->halves = next_random_word(bits);
+		bits->halves_left = 2;
+	}
+	uint64_t p = (uint32_t)(bits->halves >> (32 * --bits->halves_left)) * n;
+	if((uint32_t)p < n) {
+		uint32_t threshold = -(uint32_t)n % (uint32_t)n;
+		while((uint32_t)p < threshold) p = (uint32_t)next_random_word(bits) * n;
+	}
+	return p >> 32;
+}
+
+// binary_tree_band runs the binary tree algorithm on cells from up to to, from must
+// start a bitset word. A random bit picks north where a cell could go both ways.
+void binary_tree_band(Maze *m, Rng *rng, uint64_t from, uint64_t to) {
+	Random_bits bits = { .left = 0 };
+	rng_lanes_seed(&bits.lanes, rng);
+	Word_masks masks = { .edge = from - column(m, from) + m->columns - 1 };
+	for(uint64_t first=from; first<to; first+=64) {
+		word_masks(m, &masks, first, to);
+		uint64_t rnd = next_random_word(&bits);
+		m->east_links[BIT_WORD(first)] |= masks.valid & masks.east & ~(rnd & masks.north);
+		set_north_links(m, first, masks.valid & masks.north & (rnd | ~masks.east));
+	}
+}
+
+// sidewinder_band runs the sidewinder algorithm on cells from up to to, from must
+// start a bitset word. A clear random bit closes out the run, a run is also closed
+// where the band ends, except in the top row which is one long corridor. Closed runs
+// then pick their north link member one by one.
+void sidewinder_band(Maze *m, Rng *rng, uint64_t from, uint64_t to) {
+	Random_bits bits = { .left = 0 };
+	rng_lanes_seed(&bits.lanes, rng);
+	Word_masks masks = { .edge = from - column(m, from) + m->columns - 1 };
+	uint64_t run_start = from;
+	for(uint64_t first=from; first<to; first+=64) {
+		word_masks(m, &masks, first, to);
+		uint64_t close = ~masks.east | (masks.north & ~next_random_word(&bits));
+		if(to - first <= 64) close |= masks.north & BIT_MASK(to - 1 - first);
+		close &= masks.valid;
+		m->east_links[BIT_WORD(first)] |= masks.valid & ~close;
+
+		uint64_t north = 0;
+		for(uint64_t runs=close; runs; runs&=runs-1) {
+			uint64_t c = first + __builtin_ctzll(runs);
+			if(masks.north & BIT_MASK(c - first)) {
+				uint64_t member = run_start + next_random_below(&bits, rng, c - run_start + 1);
+				if(member >= first) north |= BIT_MASK(member - first);
+				else link_direction(m, member, NORTH);
 			}
+			run_start = c + 1;
 		}
+		set_north_links(m, first, north);
+	}
+}
+
+// ### parallel generation
+
+// Large grids are cut into bands that start on a bitset word boundary, so every
+// band writes its own words of the wall sets and bands can be generated at the same
+// time. Each band draws from its own random generator, a jump apart from the next,
+// so the maze only depends on the seed and not on which thread took which band.
+typedef struct Gen_bands {
+	Maze *maze;
+	void (*generate)(Maze *m);
+	Pool *pool;
+	Rng *rng;             // one generator per band
+	uint64_t band_cells;  // cell bands: cells per band, a multiple of 64
+	uint64_t band_rows;   // row bands: rows per band, band_rows * columns is a multiple of 64
+	uint64_t band_count;
+	uint64_t first_band;  // bands first_band, first_band + band_step, ... are taken this pass
+	uint64_t band_step;
+	uint64_t next;        // next band to hand out, taken atomically
+	bool sidewinder;
+	bool first_touch;     // bands go to the worker that touched their memory first
+} Gen_bands;
+
+// With first touch placement the grid is cut into one run of cells per worker, see
+// clear_maze_links(). touch_run_start returns where the run of worker starts.
+static uint64_t touch_run_start(uint64_t cell_count, int worker, int workers) {
+	if(worker >= workers) return cell_count;
+	return (uint64_t)((unsigned __int128)cell_count * worker / workers) & ~63ULL;
+}
+
+// touch_owner returns the worker whose run holds cell c
+static int touch_owner(uint64_t cell_count, uint64_t c, int workers) {
+	int worker = (int)((unsigned __int128)c * workers / cell_count);
+	while(worker+1 < workers && touch_run_start(cell_count, worker+1, workers) <= c) worker++;
+	return worker;
+}
 
-		front_count = new_front_count;
-		for(int k=0; k<new_front_count; k++) front[k] = new_front[k];
+// take_band returns the next band of this pass for worker, or band_count when none
+// is left. Bands are handed out as workers ask for them, or with first touch
+// placement to the worker whose run their first cell is in, so each band is made
+// on the NUMA node its memory is on. cursor starts at first_band.
+static uint64_t take_band(Gen_bands *bands, uint64_t *cursor, int worker, int workers) {
+	Maze *m = bands->maze;
+	if(!bands->first_touch) {
+		uint64_t band = __atomic_fetch_add(&bands->next, 1, __ATOMIC_RELAXED) * bands->band_step + bands->first_band;
+		return MIN(band, bands->band_count);
 	}
-	return max_distance_cell;
+	for(uint64_t band=*cursor; band<bands->band_count; band+=bands->band_step) {
+		uint64_t first_cell = bands->band_cells ? band * bands->band_cells : band * bands->band_rows * m->columns;
+		if(touch_owner(size(m), first_cell, workers) == worker) {
+			*cursor = band + bands->band_step;
+			return band;
+		}
+	}
+	*cursor = bands->band_count;
+	return bands->band_count;
+}
+
+// cell_bands_job generates whole cell bands with binary tree or sidewinder
+static void cell_bands_job(void *arg, int worker, int workers) {
+	Gen_bands *bands = (Gen_bands*)arg;
+	Maze *m = bands->maze;
+	uint64_t cell_count = size(m);
+	uint64_t cursor = bands->first_band;
+	uint64_t band;
+	while((band = take_band(bands, &cursor, worker, workers)) < bands->band_count) {
+		uint64_t from = band * bands->band_cells;
+		uint64_t to = MIN(from + bands->band_cells, cell_count);
+		if(bands->sidewinder) sidewinder_band(m, &bands->rng[band], from, to);
+		else binary_tree_band(m, &bands->rng[band], from, to);
+	}
+}
+
+// row_bands_job generates every row band as a maze of its own, through a view
+// whose wall sets point into the bands words of the full maze. The views take
+// their scratch memory from the arena of the pool worker.
+static void row_bands_job(void *arg, int worker, int workers) {
+	Gen_bands *bands = (Gen_bands*)arg;
+	Maze *m = bands->maze;
+	Arena *arena = &bands->pool->workers[worker].arena;
+	uint64_t cursor = 0;
+	uint64_t band;
+	while((band = take_band(bands, &cursor, worker, workers)) < bands->band_count) {
+		uint64_t first_row = band * bands->band_rows;
+		uint64_t first_cell = first_row * m->columns;
+		Maze view = {
+			.columns = m->columns,
+			.rows = band + 1 < bands->band_count ? bands->band_rows : m->rows - first_row,
+			.east_links = m->east_links + BIT_WORD(first_cell),
+			.south_links = m->south_links + BIT_WORD(first_cell),
+			.threads = 1,
+			.seed = m->seed,
+			.rng = bands->rng[band],
+			.arena = *arena
+		};
+		bands->generate(&view);
+		*arena = view.arena;
+		arena_reset(arena);
+	}
+}
+
+static Rng *band_generators(Maze *m, uint64_t band_count) {
+	Rng *rng = (Rng*)arena_alloc(&m->arena, ALLOC_GENERATE_MAZE, band_count * sizeof(Rng));
+	for(uint64_t band=0; band<band_count; band++) {
+		rng[band] = m->rng;
+		rng_jump(&m->rng);
+	}
+	return rng;
+}
+
+// generate_cell_bands runs binary tree or sidewinder on bands of whole bitset words.
+// Only north links cross bands, into the band before, and a band is at least a row
+// long so they never reach further back. Even bands go first and odd bands second,
+// so no two bands ever write to the same word at the same time.
+static void generate_cell_bands(Maze *m, bool sidewinder) {
+	uint64_t cell_count = size(m);
+	Gen_bands bands = { .maze = m, .sidewinder = sidewinder, .band_step = 2, .first_touch = m->first_touch };
+	bands.band_cells = MAX((uint64_t)PARALLEL_GEN_BAND, (m->columns + 63) & ~63ULL);
+	bands.band_count = (cell_count + bands.band_cells - 1) / bands.band_cells;
+	Arena_mark mark = arena_mark(&m->arena);
+	bands.rng = band_generators(m, bands.band_count);
+
+	bands.pool = maze_pool(m);
+	for(bands.first_band=0; bands.first_band<2; bands.first_band++) {
+		bands.next = 0;
+		pool_run(bands.pool, cell_bands_job, &bands);
+	}
+	arena_release(&m->arena, mark);
+	if(m->draw_live) replay_links(m);
+}
+
+// generate_row_bands generates bands of whole rows concurrently with any algorithm,
+// then joins each band to the one below with a single south link, which keeps the
+// maze perfect: every band is a spanning tree and the links join them into one.
+// Bands are at least PARALLEL_GEN_MIN_ROWS high, the last one takes the rows left
+// over, and grids too low for two bands are generated whole.
+static void generate_row_bands(Maze *m, void (*generate)(Maze *m)) {
+	// the rows a band needs so that it starts on a word boundary
+	uint64_t row_step = 64 >> MIN(__builtin_ctzll(m->columns), 6);
+	uint64_t band_rows = MAX((PARALLEL_GEN_BAND + m->columns - 1) / m->columns, (uint64_t)PARALLEL_GEN_MIN_ROWS);
+	band_rows = (band_rows + row_step - 1) / row_step * row_step;
+	if(band_rows * 2 > m->rows) {
+		generate(m);
+		return;
+	}
+	Gen_bands bands = { .maze = m, .generate = generate, .band_rows = band_rows, .band_step = 1, .first_touch = m->first_touch };
+	bands.band_count = m->rows / band_rows;
+	Arena_mark mark = arena_mark(&m->arena);
+	bands.rng = band_generators(m, bands.band_count);
+
+	bands.pool = maze_pool(m);
+	pool_run(bands.pool, row_bands_job, &bands);
+	arena_release(&m->arena, mark);
+
+	for(uint64_t band=1; band<bands.band_count; band++)
+		link_direction(m, cell(m, rng_below(&m->rng, m->columns), band * band_rows - 1), SOUTH);
+}
+
+// generate_maze runs generate on m. Binary tree and sidewinder only look at a cell's
+// own row and the row above, so large grids of theirs are always cut into cell
+// bands. Every other algorithm is only cut into row bands when m->bands is set, as
+// a maze of bands joined by single links is not the one the algorithm would make.
+// Bands depend on the grid size alone, so a seed gives the same maze whatever the
+// thread count, with a single thread the bands run one after the other. Drawn
+// live, row banded algorithms run whole instead, to show every step.
+void generate_maze(Maze *m, void (*generate)(Maze *m)) {
+	bool cell_bands = generate == &binary_tree_maze || generate == &sidewinder_maze;
+	if(size(m) < PARALLEL_GEN_CELLS || (!cell_bands && (!m->bands || m->draw_live))) {
+		generate(m);
+	} else if(cell_bands) {
+		generate_cell_bands(m, generate == &sidewinder_maze);
+	} else {
+		generate_row_bands(m, generate);
+	}
+}
+
+// furthest_cell returns the lowest index at the largest distance, the same cell
+// calculate_distances() returns, for distances that were loaded instead of solved
+uint64_t furthest_cell(Maze *m) {
+	uint64_t cell_count = size(m);
+	uint64_t furthest = 0;
+	for(uint64_t c=1; c<cell_count; c++)
+		if(m->distance[c] != NO_DISTANCE && m->distance[c] > m->distance[furthest]) furthest = c;
+	return furthest;
 }
 
-int dead_ends() {
-	int cell_count = Columns * Rows;
-	int deads = 0;
-	for(int i=0; i<cell_count; i++) {
-		Cell *c = Grid[i];
-		if(c->links_count == DEAD_END) {
-			c->marker = '*';
+// ### parallel distances
+
+// The parallel solver cuts the grid into bands of whole rows. Within a band the links
+// of a perfect maze fall apart into trees, its components, and as the maze is a tree
+// the path from root enters each component through a single cell, its entry. The
+// distance of a cell is then the distance of its component's entry from root plus
+// its distance from the entry within the band. Bands are labelled and solved on all
+// threads, only the components and the links between bands are walked on one.
+typedef struct Bfs_bands {
+	Maze *maze;
+	Pool *pool;
+	uint64_t band_rows;        // the last band also takes the rows left over
+	uint64_t band_count;
+	uint64_t next;             // next band to hand out, taken atomically
+	uint32_t *component;       // per cell: its component within its band
+	uint64_t *first_component; // per band: its components are numbered from here on
+	uint64_t *band_links;      // per band: links within the band
+	uint64_t *entry;           // per component: the cell the path from root enters it by
+	uint64_t *offset;          // per component: the distance of its entry from root
+	uint64_t *furthest;        // per band: lowest cell at the largest distance
+} Bfs_bands;
+
+static uint64_t bfs_band_start(Bfs_bands *bands, uint64_t band) {
+	if(band >= bands->band_count) return size(bands->maze);
+	return band * bands->band_rows * bands->maze->columns;
+}
+
+// bfs_component returns the number of the component of cell c among all bands
+static uint64_t bfs_component(Bfs_bands *bands, uint64_t c) {
+	uint64_t band = MIN(c / bands->maze->columns / bands->band_rows, bands->band_count - 1);
+	return bands->first_component[band] + bands->component[c];
+}
+
+// bfs_label_job numbers the components of every band it takes, counts the links
+// within the band and clears its distances
+static void bfs_label_job(void *arg, int worker, int workers) {
+	(void)workers;
+	Bfs_bands *bands = (Bfs_bands*)arg;
+	Maze *m = bands->maze;
+	Arena *arena = &bands->pool->workers[worker].arena;
+	uint64_t band;
+	while((band = __atomic_fetch_add(&bands->next, 1, __ATOMIC_RELAXED)) < bands->band_count) {
+		uint64_t from = bfs_band_start(bands, band);
+		uint64_t to = bfs_band_start(bands, band+1);
+		uint32_t *queue = (uint32_t*)arena_alloc(arena, ALLOC_DISTANCES, (to - from) * sizeof(uint32_t));
+		memset(bands->component + from, 0xff, (to - from) * sizeof(uint32_t)); // BFS_UNLABELLED
+		memset(m->distance + from, 0xff, (to - from) * sizeof(uint32_t));      // NO_DISTANCE
+		uint32_t components = 0;
+		uint64_t links_within = 0;
+		for(uint64_t c=from; c<to; c++) {
+			if(bands->component[c] != BFS_UNLABELLED) continue;
+			uint32_t label = components++;
+			bands->component[c] = label;
+			uint64_t head = 0;
+			uint64_t tail = 0;
+			queue[tail++] = (uint32_t)(c - from);
+			while(head < tail) {
+				uint64_t cell = from + queue[head++];
+				uint8_t l = links(m, cell);
+				for(enum Direction d=NORTH; d<=WEST; d<<=1) {
+					if(!(l & d)) continue;
+					uint64_t n = step(m, cell, d);
+					if(n < from || n >= to) continue; // links between bands are walked later
+					links_within++;
+					if(bands->component[n] != BFS_UNLABELLED) continue;
+					bands->component[n] = label;
+					queue[tail++] = (uint32_t)(n - from);
+				}
+			}
+		}
+		bands->first_component[band+1] = components;
+		bands->band_links[band] = links_within / 2; // every link is seen from both of its cells
+		arena_reset(arena);
+	}
+}
+
+// bfs_entries_job solves every band it takes from the entries of its components,
+// the distances are from the entries for now
+static void bfs_entries_job(void *arg, int worker, int workers) {
+	(void)workers;
+	Bfs_bands *bands = (Bfs_bands*)arg;
+	Maze *m = bands->maze;
+	Arena *arena = &bands->pool->workers[worker].arena;
+	uint64_t band;
+	while((band = __atomic_fetch_add(&bands->next, 1, __ATOMIC_RELAXED)) < bands->band_count) {
+		uint64_t from = bfs_band_start(bands, band);
+		uint64_t to = bfs_band_start(bands, band+1);
+		uint32_t *queue = (uint32_t*)arena_alloc(arena, ALLOC_DISTANCES, (to - from) * sizeof(uint32_t));
+		uint64_t head = 0;
+		uint64_t tail = 0;
+		for(uint64_t k=bands->first_component[band]; k<bands->first_component[band+1]; k++) {
+			m->distance[bands->entry[k]] = 0;
+			queue[tail++] = (uint32_t)(bands->entry[k] - from);
+		}
+		while(head < tail) {
+			uint64_t cell = from + queue[head++];
+			uint32_t next_distance = m->distance[cell] + 1;
+			uint8_t l = links(m, cell);
+			for(enum Direction d=NORTH; d<=WEST; d<<=1) {
+				if(!(l & d)) continue;
+				uint64_t n = step(m, cell, d);
+				if(n < from || n >= to || m->distance[n] != NO_DISTANCE) continue;
+				m->distance[n] = next_distance;
+				queue[tail++] = (uint32_t)(n - from);
+			}
+		}
+		arena_reset(arena);
+	}
+}
+
+// bfs_offset_job adds the distance of the entries from root to every band it takes
+// and finds the band's furthest cell
+static void bfs_offset_job(void *arg, int worker, int workers) {
+	(void)worker;
+	(void)workers;
+	Bfs_bands *bands = (Bfs_bands*)arg;
+	Maze *m = bands->maze;
+	uint64_t band;
+	while((band = __atomic_fetch_add(&bands->next, 1, __ATOMIC_RELAXED)) < bands->band_count) {
+		uint64_t from = bfs_band_start(bands, band);
+		uint64_t to = bfs_band_start(bands, band+1);
+		uint64_t *offset = bands->offset + bands->first_component[band];
+		uint64_t furthest = from;
+		uint64_t furthest_distance = 0;
+		for(uint64_t c=from; c<to; c++) {
+			uint64_t d = m->distance[c] + offset[bands->component[c]];
+			if(d >= NO_DISTANCE) die("Maze too large for calculating distances.", EOVERFLOW);
+			m->distance[c] = (uint32_t)d;
+			if(d > furthest_distance) {
+				furthest_distance = d;
+				furthest = c;
+			}
+		}
+		bands->furthest[band] = furthest;
+	}
+}
+
+// calculate_distances_parallel solves m like calculate_distances() on the threads of
+// the maze, see Bfs_bands. Returns NO_CELL without solving when the maze is not a
+// tree, or too low or too wide to be cut into bands, the serial solver is needed then.
+uint64_t calculate_distances_parallel(Maze *m, uint64_t root) {
+	uint64_t cell_count = size(m);
+	Bfs_bands bands = { .maze = m };
+	bands.band_rows = MAX(m->rows / ((uint64_t)m->threads * PARALLEL_BFS_BANDS), (uint64_t)PARALLEL_BFS_MIN_ROWS);
+	bands.band_count = m->rows / bands.band_rows;
+	// cells within a band are queued as 32-bit offsets, the last band is the largest
+	if(bands.band_count < 2 || (m->rows - (bands.band_count - 1) * bands.band_rows) * m->columns >= UINT32_MAX) return NO_CELL;
+	bands.pool = maze_pool(m);
+
+	Arena_mark mark = arena_mark(&m->arena);
+	bands.component = (uint32_t*)arena_alloc(&m->arena, ALLOC_DISTANCES, cell_count * sizeof(uint32_t));
+	bands.first_component = (uint64_t*)arena_calloc(&m->arena, ALLOC_DISTANCES, bands.band_count + 1, sizeof(uint64_t));
+	bands.band_links = (uint64_t*)arena_alloc(&m->arena, ALLOC_DISTANCES, bands.band_count * sizeof(uint64_t));
+	bands.furthest = (uint64_t*)arena_alloc(&m->arena, ALLOC_DISTANCES, bands.band_count * sizeof(uint64_t));
+	pool_run(bands.pool, bfs_label_job, &bands);
+
+	// number the components of all bands one after the other
+	uint64_t links_within = 0;
+	for(uint64_t band=0; band<bands.band_count; band++) {
+		bands.first_component[band+1] += bands.first_component[band];
+		links_within += bands.band_links[band];
+	}
+	uint64_t components = bands.first_component[bands.band_count];
+
+	// list the links between bands by component, as the south link of their upper cell
+	uint64_t *link_start = (uint64_t*)arena_calloc(&m->arena, ALLOC_DISTANCES, components + 1, sizeof(uint64_t));
+	uint64_t crossing = 0;
+	for(uint64_t band=1; band<bands.band_count; band++) {
+		uint64_t last_row = bfs_band_start(&bands, band) - m->columns;
+		for(uint64_t c=last_row; c<last_row + m->columns; c++) {
+			if(!TEST_BIT(m->south_links, c)) continue;
+			link_start[bfs_component(&bands, c) + 1]++;
+			link_start[bfs_component(&bands, c + m->columns) + 1]++;
+			crossing++;
+		}
+	}
+	// a connected grid with one link less than it has cells is a tree
+	if(links_within + crossing != cell_count - 1) {
+		arena_release(&m->arena, mark);
+		return NO_CELL;
+	}
+	for(uint64_t k=0; k<components; k++) link_start[k+1] += link_start[k];
+	uint64_t *link_cell = (uint64_t*)arena_alloc(&m->arena, ALLOC_DISTANCES, 2 * crossing * sizeof(uint64_t));
+	for(uint64_t band=1; band<bands.band_count; band++) {
+		uint64_t last_row = bfs_band_start(&bands, band) - m->columns;
+		for(uint64_t c=last_row; c<last_row + m->columns; c++) {
+			if(!TEST_BIT(m->south_links, c)) continue;
+			link_cell[link_start[bfs_component(&bands, c)]++] = c;
+			link_cell[link_start[bfs_component(&bands, c + m->columns)]++] = c;
+		}
+	}
+	// filling moved every start to the next one's
+	for(uint64_t k=components; k>0; k--) link_start[k] = link_start[k-1];
+	link_start[0] = 0;
+
+	// walk the components from root's, each is entered by the first link to reach it.
+	// Until the entries are solved, offset holds the cell the link leaves from.
+	bands.entry = (uint64_t*)arena_alloc(&m->arena, ALLOC_DISTANCES, components * sizeof(uint64_t));
+	bands.offset = (uint64_t*)arena_alloc(&m->arena, ALLOC_DISTANCES, components * sizeof(uint64_t));
+	uint64_t *order = (uint64_t*)arena_alloc(&m->arena, ALLOC_DISTANCES, components * sizeof(uint64_t));
+	memset(bands.entry, 0xff, components * sizeof(uint64_t)); // NO_CELL
+	uint64_t root_component = bfs_component(&bands, root);
+	bands.entry[root_component] = root;
+	uint64_t head = 0;
+	uint64_t tail = 0;
+	order[tail++] = root_component;
+	while(head < tail) {
+		uint64_t k = order[head++];
+		for(uint64_t i=link_start[k]; i<link_start[k+1]; i++) {
+			uint64_t upper = link_cell[i];
+			uint64_t lower = upper + m->columns;
+			uint64_t other = bfs_component(&bands, upper) == k ? lower : upper;
+			uint64_t next = bfs_component(&bands, other);
+			if(bands.entry[next] != NO_CELL) continue;
+			bands.entry[next] = other;
+			bands.offset[next] = other == lower ? upper : lower;
+			order[tail++] = next;
+		}
+	}
+	if(tail != components) {
+		arena_release(&m->arena, mark);
+		return NO_CELL;
+	}
+
+	bands.next = 0;
+	pool_run(bands.pool, bfs_entries_job, &bands);
+
+	// the walk reaches a component after the one it is entered from
+	bands.offset[root_component] = 0;
+	for(uint64_t i=1; i<components; i++) {
+		uint64_t k = order[i];
+		uint64_t exit = bands.offset[k];
+		bands.offset[k] = bands.offset[bfs_component(&bands, exit)] + m->distance[exit] + 1;
+	}
+
+	bands.next = 0;
+	pool_run(bands.pool, bfs_offset_job, &bands);
+	uint64_t furthest = bands.furthest[0];
+	for(uint64_t band=1; band<bands.band_count; band++)
+		if(m->distance[bands.furthest[band]] > m->distance[furthest]) furthest = bands.furthest[band];
+	arena_release(&m->arena, mark);
+	return furthest;
+}
+
+// ### thread pool
+
+static void *pool_worker(void *arg) {
+	Pool_worker *self = (Pool_worker*)arg;
+	Pool *pool = self->pool;
+	uint64_t seen = 0;
+	pthread_mutex_lock(&pool->lock);
+	for(;;) {
+		while(pool->generation == seen && !pool->quit) pthread_cond_wait(&pool->wake, &pool->lock);
+		if(pool->quit) break;
+		seen = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+		pool->job(pool->arg, self->index, pool->threads);
+		pthread_mutex_lock(&pool->lock);
+		if(--pool->pending == 0) pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+// pool_create starts threads-1 workers, the thread calling pool_run() is the last one
+Pool *pool_create(int threads) {
+	Pool *pool = (Pool*)counted_calloc(ALLOC_POOL, 1, sizeof(Pool));
+	if(!pool) die("Failed to allocate memory for thread pool.", errno);
+	pool->threads = MAX(threads, 1);
+	pool->workers = (Pool_worker*)counted_calloc(ALLOC_POOL, pool->threads, sizeof(Pool_worker));
+	if(!pool->workers) die("Failed to allocate memory for thread pool.", errno);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for(int i=1; i<pool->threads; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].index = i;
+		if(pthread_create(&pool->workers[i].thread, NULL, pool_worker, &pool->workers[i]) != 0)
+			die("Failed to start worker thread.", errno);
+	}
+	return pool;
+}
+
+// maze_pool returns the threads of m, started by the first call. They are kept
+// with their arenas until free_all(), so generating and solving again starts no
+// threads and allocates nothing.
+Pool *maze_pool(Maze *m) {
+	if(!m->pool) {
+		m->pool = pool_create(m->threads);
+		// a single thread stays where it is, batch workers would all end up on one CPU
+		if(m->first_touch && m->threads > 1) pool_pin(m->pool);
+	}
+	return m->pool;
+}
+
+// pool_cpu returns the CPU of worker, the worker-th CPU the process was allowed to
+// run on at the first call, wrapping around when there are more workers than CPUs.
+// Returns -1 where threads can not be pinned.
+static int pool_cpu(int worker) {
+#ifdef __linux__
+	static cpu_set_t allowed;
+	static int cpus = 0;
+	if(cpus == 0 && (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || (cpus = CPU_COUNT(&allowed)) == 0)) return -1;
+	int n = worker % cpus;
+	int cpu = 0;
+	while(!CPU_ISSET(cpu, &allowed) || n-- > 0) cpu++;
+	return cpu;
+#else
+	return -1;
+#endif
+}
+
+#ifdef __linux__
+static void pin_thread(pthread_t thread, int cpu) {
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+#endif
+
+// pool_pin binds worker i of the pool to pool_cpu(i), so the same worker index runs
+// on the same CPU, and so the same NUMA node, in every pinned pool. The calling
+// thread is worker 0 and only bound while pool_run() runs a job, so threads it
+// starts later are not all stuck on one CPU.
+void pool_pin(Pool *pool) {
+#ifdef __linux__
+	if(pool_cpu(0) < 0) return;
+	for(int i=1; i<pool->threads; i++) pin_thread(pool->workers[i].thread, pool_cpu(i));
+	pool->pinned = true;
+#endif
+}
+
+// pool_run calls job once on every thread of the pool and waits for all of them
+void pool_run(Pool *pool, void (*job)(void *arg, int worker, int workers), void *arg) {
+	pthread_mutex_lock(&pool->lock);
+	pool->job = job;
+	pool->arg = arg;
+	pool->pending = pool->threads - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+#ifdef __linux__
+	cpu_set_t caller;
+	bool pin = pool->pinned && pthread_getaffinity_np(pthread_self(), sizeof(caller), &caller) == 0;
+	if(pin) pin_thread(pthread_self(), pool_cpu(0));
+	job(arg, 0, pool->threads);
+	if(pin) pthread_setaffinity_np(pthread_self(), sizeof(caller), &caller);
+#else
+	job(arg, 0, pool->threads);
+#endif
+
+	pthread_mutex_lock(&pool->lock);
+	while(pool->pending > 0) pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_free(Pool *pool) {
+	if(!pool) return;
+	pthread_mutex_lock(&pool->lock);
+	pool->quit = true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+	for(int i=1; i<pool->threads; i++) pthread_join(pool->workers[i].thread, NULL);
+	for(int i=0; i<pool->threads; i++) arena_free(&pool->workers[i].arena);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->wake);
+	pthread_cond_destroy(&pool->done);
+	counted_free(ALLOC_POOL, pool->workers);
+	counted_free(ALLOC_POOL, pool);
+}
+
+uint64_t dead_ends(Maze *m) {
+	uint64_t cell_count = size(m);
+	uint64_t deads = 0;
+	for(uint64_t i=0; i<cell_count; i++) {
+		if(links_count(m, i) == DEAD_END) {
+			SET_BIT(m->marked, i);
 			deads++;
 		}
 	}
@@ -606,306 +1610,1001 @@ int dead_ends() {
 
 //
 
-int index_at(int col, int row) {
-	return row * Columns + col;
+uint64_t index_at(Maze *m, uint64_t col, uint64_t row) {
+	return row * m->columns + col;
 }
 
-int row(int index) {
-	return index / Columns;
+uint64_t row(Maze *m, uint64_t index) {
+	return index / m->columns;
 }
 
-int column(int index) {
-	return index % Columns;
+uint64_t column(Maze *m, uint64_t index) {
+	return index % m->columns;
 }
 
 // return maze size
-int size() {
-	return Columns * Rows;
+uint64_t size(Maze *m) {
+	return m->columns * m->rows;
 }
 
-Cell *random_cell_from_grid(int *index) {
-	int r = rand() % size();
-	if(index) *index = r;
-	return Grid[r];
+// rng_seed expands a 64 bit seed into the xoshiro256** state using splitmix64
+void rng_seed(Rng *r, uint64_t seed) {
+	for(int i=0; i<4; i++) {
+		uint64_t z = (seed += 0x9e3779b97f4a7c15);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+		r->s[i] = z ^ (z >> 31);
+	}
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
 }
 
-Cell *random_cell_from_array(Cell **array, int length, int *index) {
-	if(!array) {
-		array = Grid;
-		length = size();
+// rng_next returns the next 64 random bits (xoshiro256**)
+uint64_t rng_next(Rng *r) {
+	uint64_t *s = r->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+// rng_jump advances r by 2^128 steps, giving a sequence that never overlaps with r
+void rng_jump(Rng *r) {
+	static const uint64_t jump[] = { 0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c };
+	uint64_t s[4] = {0};
+	for(int i=0; i<4; i++) {
+		for(int b=0; b<64; b++) {
+			if(jump[i] & (1ULL << b))
+				for(int k=0; k<4; k++) s[k] ^= r->s[k];
+			rng_next(r);
+		}
 	}
-	int r = rand() % length;
-	if(index) *index = r;
-	return array[r];
+	memcpy(r->s, s, sizeof(s));
 }
 
-void clear_maze_links() {
-	int s = size();
-	for(int i=0; i<s; i++) {
-		Cell *c = Grid[i];
-		for(int l=0;l<c->links_count;l++) {
-			c->links[l] = NULL;
+// rng_below returns an unbiased random number in [0, n), n must not be 0.
+// Lemire's multiply and reject: the division only runs on the rare retry path.
+uint64_t rng_below(Rng *r, uint64_t n) {
+	__uint128_t p = (__uint128_t)rng_next(r) * n;
+	uint64_t low = (uint64_t)p;
+	if(low < n) {
+		uint64_t threshold = -n % n;
+		while(low < threshold) {
+			p = (__uint128_t)rng_next(r) * n;
+			low = (uint64_t)p;
 		}
-		c->links_count = 0;
 	}
+	return (uint64_t)(p >> 64);
+}
+
+uint64_t random_cell_from_grid(Maze *m, uint64_t *index) {
+	uint64_t r = rng_below(&m->rng, size(m));
+	if(index) *index = r;
+	return r;
 }
 
-clock_t performance_test(void (*alg)(), int runs) {
-	clock_t t = clock();
+uint64_t random_cell_from_array(Maze *m, uint64_t *array, uint64_t length, uint64_t *index) {
+	uint64_t r = rng_below(&m->rng, array ? length : size(m));
+	if(index) *index = r;
+	return array ? array[r] : r;
+}
+
+// clear_cells clears cells from to to of every per cell array, from and to are
+// multiples of 64 or the end of the grid
+static void clear_cells(Maze *m, uint64_t from, uint64_t to) {
+	uint64_t words = BIT_WORDS(to) - BIT_WORD(from);
+	memset(m->east_links + BIT_WORD(from), 0, words * sizeof(uint64_t));
+	memset(m->south_links + BIT_WORD(from), 0, words * sizeof(uint64_t));
+	memset(m->marked + BIT_WORD(from), 0, words * sizeof(uint64_t));
+	memset(m->path + BIT_WORD(from), 0, words * sizeof(uint64_t));
+	memset(m->distance + from, 0xff, (to - from) * sizeof(uint32_t)); // NO_DISTANCE
+}
+
+static void clear_cells_job(void *arg, int worker, int workers) {
+	Maze *m = (Maze*)arg;
+	clear_cells(m, touch_run_start(size(m), worker, workers), touch_run_start(size(m), worker+1, workers));
+}
+
+// clear_maze_links resets m to a grid of closed cells, dropping the distances,
+// markers and path of the previous maze as well. With first touch placement
+// each pinned worker clears its own run of the grid, which for freshly mapped
+// memory puts the pages on the worker's NUMA node, see take_band().
+void clear_maze_links(Maze *m) {
+	if(m->first_touch && m->threads > 1 && size(m) >= PARALLEL_GEN_CELLS) {
+		pool_run(maze_pool(m), clear_cells_job, m);
+	} else {
+		clear_cells(m, 0, size(m));
+	}
+}
+
+// performance_test returns the time runs generations take in ms, on the monotonic
+// clock so time spent in other threads is not counted
+double performance_test(Maze *m, void (*alg)(Maze *m), int runs) {
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
 	for(int i=0; i<runs; i++) {
-		(*alg)();
-		clear_maze_links();
+		(*alg)(m);
+		clear_maze_links(m);
 	}
-	clock_t time_passed = clock() - t;
-	return time_passed;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
 }
 
+// ### profiling
 
+double monotonic_ms(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
 
-// ### output
+// lap_ms returns the ms passed since *since and starts the next lap
+double lap_ms(double *since) {
+	double now = monotonic_ms();
+	double lap = now - *since;
+	*since = now;
+	return lap;
+}
 
-// warning: caller expected to free malloced array
+static Alloc_count Alloc_counts[ALLOC_SITES];
+static const char *Alloc_site_names[ALLOC_SITES] = {
+	"arena chunks", "initialize", "generator", "stack_push", "eller", "generate_maze",
+	"pool", "calculate_distances", "path_to", "output", "live view"
+};
+static const char *Profile_counter_names[PROFILE_COUNTERS] = {
+	"cycles", "instructions", "l1d misses", "llc misses", "branch misses"
+};
+
+// counted_malloc and friends count every call and the bytes asked for per site.
+// The counters are shared by all threads, so they are updated atomically.
+static void count_allocation(enum Alloc_site site, uint64_t *calls, size_t n) {
+	__atomic_fetch_add(calls, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&Alloc_counts[site].bytes, n, __ATOMIC_RELAXED);
+}
 
-size_t get_maze_string_size() {
-	size_t str_size = (Columns * 4 + 1) * (Rows * 2 + 1);
-	str_size += Rows * 2; // for newlines, 2 newlines for each row
-	str_size += 1;	      // for '\0'
-	return str_size;
+void *counted_malloc(enum Alloc_site site, size_t n) {
+	count_allocation(site, &Alloc_counts[site].mallocs, n);
+	return malloc(n);
 }
 
-// warning: caller expected to free returned malloced array
-Cell **path_to(Cell *goal, int max_path) {
-	if(!goal->solved) die("Trying to find closest path before solving maze.", errno);
-	Cell *current = goal;
-	Cell **breadcrumbs = (Cell**)malloc((max_path+1) * sizeof(Cell*));
-	if(!breadcrumbs) die("Failed to allocate memory for breadcrumbs array.", errno);
-	int breadcrumbs_counter = 0;
-	breadcrumbs[breadcrumbs_counter++] = current;
-	current->path = true;
-	while(current->distance >= 0 && breadcrumbs_counter <= max_path) {
-		int lowest = current->distance;
-		Cell *candidate;
-		for(int i=0; i<current->links_count; i++) {
-			if(current->links[i]->distance < lowest) {
-				lowest = current->links[i]->distance;
-				candidate = current->links[i];
-			}
+void *counted_calloc(enum Alloc_site site, size_t count, size_t n) {
+	count_allocation(site, &Alloc_counts[site].mallocs, count * n);
+	return calloc(count, n);
+}
+
+void counted_free(enum Alloc_site site, void *p) {
+	if(p) __atomic_fetch_add(&Alloc_counts[site].frees, 1, __ATOMIC_RELAXED);
+	free(p);
+}
+
+void alloc_counts(Alloc_count out[ALLOC_SITES]) {
+	for(int i=0; i<ALLOC_SITES; i++) {
+		out[i].mallocs = __atomic_load_n(&Alloc_counts[i].mallocs, __ATOMIC_RELAXED);
+		out[i].frees = __atomic_load_n(&Alloc_counts[i].frees, __ATOMIC_RELAXED);
+		out[i].arena = __atomic_load_n(&Alloc_counts[i].arena, __ATOMIC_RELAXED);
+		out[i].bytes = __atomic_load_n(&Alloc_counts[i].bytes, __ATOMIC_RELAXED);
+	}
+}
+
+// open_counters opens and starts the hardware counters of the calling thread and
+// of the threads it starts from now on. Counters the kernel refuses, e.g. because
+// of perf_event_paranoid or on other systems than Linux, are left at -1.
+static void open_counters(int fd[PROFILE_COUNTERS]) {
+	for(int i=0; i<PROFILE_COUNTERS; i++) fd[i] = -1;
+#ifdef __linux__
+	static const uint32_t types[PROFILE_COUNTERS] = {
+		PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+	};
+	static const uint64_t configs[PROFILE_COUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+	for(int i=0; i<PROFILE_COUNTERS; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = types[i];
+		attr.config = configs[i];
+		attr.disabled = 1;
+		attr.inherit = 1; // pools started during the run
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+	for(int i=0; i<PROFILE_COUNTERS; i++) {
+		if(fd[i] < 0) continue;
+		ioctl(fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+// close_counters stops the counters opened by open_counters() and adds what they
+// counted to count
+static void close_counters(int fd[PROFILE_COUNTERS], uint64_t count[PROFILE_COUNTERS]) {
+#ifdef __linux__
+	for(int i=0; i<PROFILE_COUNTERS; i++) {
+		if(fd[i] < 0) continue;
+		ioctl(fd[i], PERF_EVENT_IOC_DISABLE, 0);
+		uint64_t value;
+		if(read(fd[i], &value, sizeof(value)) == sizeof(value)) __atomic_fetch_add(&count[i], value, __ATOMIC_RELAXED);
+		close(fd[i]);
+	}
+#endif
+}
+
+// Inherited counters only follow threads started after them, so the threads of a
+// pool that is already running open counters of their own, worker 0 being the
+// caller that has them already.
+static void open_worker_counters(void *arg, int worker, int workers) {
+	(void)workers;
+	Profile *p = (Profile*)arg;
+	if(worker == 0) return;
+	int *fd = p->pool->workers[worker].profile_fd;
+	open_counters(fd);
+	for(int i=0; i<PROFILE_COUNTERS; i++)
+		if(fd[i] < 0 && p->fd[i] >= 0) __atomic_store_n(&p->incomplete[i], true, __ATOMIC_RELAXED);
+}
+
+static void close_worker_counters(void *arg, int worker, int workers) {
+	(void)workers;
+	Profile *p = (Profile*)arg;
+	if(worker > 0) close_counters(p->pool->workers[worker].profile_fd, p->count);
+}
+
+// profile_start starts the hardware counters for the calling thread, the threads of
+// pool if it is running already and any threads started during the run
+void profile_start(Profile *p, Pool *pool) {
+	memset(p, 0, sizeof(*p));
+	open_counters(p->fd);
+	p->pool = pool;
+	if(pool) pool_run(pool, open_worker_counters, p);
+	alloc_counts(p->alloc);
+	p->ms = monotonic_ms();
+}
+
+// profile_stop stops the counters, p then holds what happened since profile_start()
+void profile_stop(Profile *p) {
+	p->ms = monotonic_ms() - p->ms;
+	Alloc_count now[ALLOC_SITES];
+	alloc_counts(now);
+	for(int i=0; i<ALLOC_SITES; i++) {
+		p->alloc[i].mallocs = now[i].mallocs - p->alloc[i].mallocs;
+		p->alloc[i].frees = now[i].frees - p->alloc[i].frees;
+		p->alloc[i].arena = now[i].arena - p->alloc[i].arena;
+		p->alloc[i].bytes = now[i].bytes - p->alloc[i].bytes;
+	}
+	if(p->pool) pool_run(p->pool, close_worker_counters, p);
+	close_counters(p->fd, p->count);
+	// a count that misses threads is not shown at all
+	for(int i=0; i<PROFILE_COUNTERS; i++)
+		if(p->incomplete[i]) p->fd[i] = -1;
+}
+
+// profile_algorithms generates a maze of m's size with every algorithm and writes
+// the hardware counters and the allocations of each run to out
+void profile_algorithms(Maze *m, FILE *out) {
+	fprintf(out, "    profiling algorithms, size %" PRIu64 " x %" PRIu64 "\n", m->columns, m->rows);
+	for(size_t i=0; i<Algorithms_count; i++) {
+		clear_maze_links(m);
+		rng_seed(&m->rng, m->seed);
+		Profile p;
+		// the maze's pool keeps running from one algorithm to the next
+		profile_start(&p, m->pool);
+		generate_maze(m, Algorithms[i].generate);
+		profile_stop(&p);
+
+		fprintf(out, "    %s = %.1f ms", Algorithms[i].name, p.ms);
+		for(int c=0; c<PROFILE_COUNTERS; c++) {
+			if(p.fd[c] < 0) fprintf(out, ", %s n/a", Profile_counter_names[c]);
+			else fprintf(out, ", %s %" PRIu64, Profile_counter_names[c], p.count[c]);
+		}
+		if(p.fd[PROFILE_CYCLES] >= 0 && p.fd[PROFILE_INSTRUCTIONS] >= 0 && p.count[PROFILE_CYCLES] > 0)
+			fprintf(out, ", %.2f instructions per cycle", (double)p.count[PROFILE_INSTRUCTIONS] / p.count[PROFILE_CYCLES]);
+		fprintf(out, "\n");
+		for(int s=0; s<ALLOC_SITES; s++) {
+			Alloc_count *a = &p.alloc[s];
+			if(a->mallocs == 0 && a->frees == 0 && a->arena == 0) continue;
+			fprintf(out, "        %s: %" PRIu64 " malloc, %" PRIu64 " free, %" PRIu64 " from arena, %" PRIu64 " bytes\n",
+				Alloc_site_names[s], a->mallocs, a->frees, a->arena, a->bytes);
+
 		}
-		breadcrumbs[breadcrumbs_counter++] = candidate;
-		candidate->path = true;
-		current = candidate;
 	}
-	return breadcrumbs;
 }
 
-void to_string(char str_out[], size_t str_size, bool print_distances) {
 
-	str_out[str_size - 1] = '\0';
+// ### arena
 
-	char *str_header = str_out;
+// map_chunk maps a chunk with room for size bytes on huge pages: reserved ones with
+// MAP_HUGETLB, or else pages aligned to the huge page size that the kernel is asked
+// to back with transparent huge pages. Returns NULL when nothing could be mapped.
+static Arena_chunk *map_chunk(Arena *a, size_t size) {
+	size_t length = (sizeof(Arena_chunk) + size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+	char *p = (char*)MAP_FAILED;
+#ifdef MAP_HUGETLB
+	if(a->pages == PAGES_HUGETLB) {
+		p = (char*)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(p == MAP_FAILED) a->hugetlb_fallback = true; // none reserved, see /proc/sys/vm/nr_hugepages
+	}
+#endif
+	if(p == MAP_FAILED) {
+		// map a huge page more and trim it, so the chunk starts on a huge page boundary
+		char *mapping = (char*)mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mapping == MAP_FAILED) return NULL;
+		p = (char*)(((uintptr_t)mapping + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+		if(p > mapping) munmap(mapping, p - mapping);
+		munmap(p + length, mapping + HUGE_PAGE_SIZE - p);
+#ifdef MADV_HUGEPAGE
+		madvise(p, length, MADV_HUGEPAGE);
+#endif
+	}
+	count_allocation(ALLOC_ARENA, &Alloc_counts[ALLOC_ARENA].mallocs, length);
+	Arena_chunk *chunk = (Arena_chunk*)p;
+	chunk->size = length - sizeof(Arena_chunk);
+	chunk->mapped = length;
+	return chunk;
+}
 
-	strcpy(str_header, "+");
-	str_header++;
+// arena_alloc hands out n bytes from the current chunk, moving on to the next
+// chunk when it is full. Chunks past the current one are empty, they are kept by
+// arena_reset() and arena_release(), so doing the same work again walks the same
+// chunks without a single malloc. Only a request that fits no kept chunk adds one.
+void *arena_alloc(Arena *a, enum Alloc_site site, size_t n) {
+	n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	Arena_chunk *last = NULL;
+	for(Arena_chunk *c=a->current; c; last=c, c=c->next) {
+		if(c != a->current) c->used = 0;
+		uintptr_t start = ((uintptr_t)c->data + c->used + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1);
+		if(start + n <= (uintptr_t)c->data + c->size) {
+			c->used = start + n - (uintptr_t)c->data;
+			a->current = c;
+			__atomic_fetch_add(&Alloc_counts[site].arena, 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&Alloc_counts[site].bytes, n, __ATOMIC_RELAXED);
+			return (void*)start;
+		}
+	}
+	size_t chunk_size = MAX(n + ARENA_ALIGN, (size_t)ARENA_CHUNK);
+	Arena_chunk *chunk = NULL;
+	if(a->pages != PAGES_DEFAULT && chunk_size >= HUGE_PAGE_SIZE) chunk = map_chunk(a, chunk_size);
+	if(!chunk) {
+		chunk = (Arena_chunk*)counted_malloc(ALLOC_ARENA, sizeof(Arena_chunk) + chunk_size);
+		if(!chunk) die("Failed to allocate memory for maze arena.", errno);
+		chunk->size = chunk_size;
+		chunk->mapped = 0;
+	}
+	chunk->next = NULL;
+	chunk->used = 0;
+	if(last) last->next = chunk;
+	else a->first = chunk;
+	a->current = chunk;
+	return arena_alloc(a, site, n);
+}
 
-	for (int col = 0; col < Columns; col++) {
-		strcpy(str_header, "---+");
-		str_header += 4;
+void *arena_calloc(Arena *a, enum Alloc_site site, size_t count, size_t n) {
+	void *p = arena_alloc(a, site, count * n);
+	memset(p, 0, count * n);
+	return p;
+}
+
+Arena_mark arena_mark(Arena *a) {
+	return (Arena_mark){ .chunk = a->current, .used = a->current ? a->current->used : 0 };
+}
+
+// arena_release frees everything allocated since mark was taken
+void arena_release(Arena *a, Arena_mark mark) {
+	if(!mark.chunk) {
+		arena_reset(a);
+		return;
 	}
+	a->current = mark.chunk;
+	a->current->used = mark.used;
+}
 
-	strcpy(str_header, "\n");
-	str_header++;
+// arena_reset frees everything in the arena at once, the chunks are kept
+void arena_reset(Arena *a) {
+	a->current = a->first;
+	if(a->first) a->first->used = 0;
+}
 
-	for (int row = 0; row < Rows; row++) {
-		int line_length = Columns * 4 + 1;
-		char top[line_length + 1];    // +1 for '\0'
-		char bottom[line_length + 1]; // +1 for '\0'
+void arena_free(Arena *a) {
+	Arena_chunk *c = a->first;
+	while(c) {
+		Arena_chunk *next = c->next;
+		if(c->mapped) {
+			__atomic_fetch_add(&Alloc_counts[ALLOC_ARENA].frees, 1, __ATOMIC_RELAXED);
+			munmap(c, c->mapped);
+		} else {
+			counted_free(ALLOC_ARENA, c);
+		}
+		c = next;
+	}
+	a->first = a->current = NULL;
+}
 
-		top[line_length] = '\0';
-		bottom[line_length] = '\0';
+// arena_size returns the bytes of the chunks the arena holds
+size_t arena_size(Arena *a) {
+	size_t bytes = 0;
+	for(Arena_chunk *c=a->first; c; c=c->next) bytes += c->size;
+	return bytes;
+}
 
-		char *top_header = top;
-		strcpy(top_header, "|");
-		top_header++;
+// ### stats
 
-		char *bottom_header = bottom;
-		strcpy(bottom_header, "+");
-		bottom_header++;
+static const char *Phase_names[PHASES] = {
+	"initialize", "generate", "calculate_distances", "path_to", "to_string", "export"
+};
 
-		for (int col = 0; col < Columns; col++) {
-			Cell *c = Grid[index_at(col, row)];
-			if (linked(c, c->east)) {
-				if(print_distances) {
-					if(c->path) sprintf(top_header, "%s%2d* ", top_header, c->distance);
-					else sprintf(top_header, "%s%2d  ", top_header, c->distance);
-				} else {
-					//strcpy(top_header, "    ");
-					sprintf(top_header, "%s %c  ", top_header, c->marker);
-				}
-			} else {
-				if(print_distances) {
-					if(c->path) sprintf(top_header, "%s%2d*|", top_header, c->distance);
-					else sprintf(top_header, "%s%2d |", top_header, c->distance);
-				} else {
-					//strcpy(top_header, "   |");
-					sprintf(top_header, "%s %c |", top_header, c->marker);
-				}
-			}
-			top_header += 4;
+// maze_arena_bytes returns the memory held by the arenas of m and of its threads,
+// with a batch every worker has its own maze and so its own arenas
+static uint64_t maze_arena_bytes(Maze *m) {
+	uint64_t bytes = arena_size(&m->arena) + arena_size(&m->live.arena);
+	if(m->pool)
+		for(int i=0; i<m->pool->threads; i++) bytes += arena_size(&m->pool->workers[i].arena);
+	return bytes;
+}
+
+// write_stats writes s as one line of json to out, together with the peak resident
+// memory of the process and the memory held by the arenas of the maze
+void write_stats(Maze *m, Maze_stats *s, FILE *out) {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+	uint64_t peak_rss = (uint64_t)usage.ru_maxrss;        // bytes
+#else
+	uint64_t peak_rss = (uint64_t)usage.ru_maxrss * 1024; // kilobytes
+#endif
+
+	fprintf(out, "{\"maze\": %" PRIu64 ", \"seed\": %" PRIu64 ", \"algorithm\": \"%s\", \"columns\": %" PRIu64 ", \"rows\": %" PRIu64
+		", \"cells\": %" PRIu64 ", \"threads\": %d, \"phases_ms\": {",
+		s->number, m->seed, s->algorithm, m->columns, m->rows, size(m), m->threads);
+	const char *separator = "";
+	for(int i=0; i<PHASES; i++) {
+		if(s->skipped & (1u << i)) continue;
+		fprintf(out, "%s\"%s\": %.3f", separator, Phase_names[i], s->ms[i]);
+		separator = ", ";
+	}
+	fprintf(out, "}, \"peak_rss_bytes\": %" PRIu64 ", \"arena_bytes\": %" PRIu64 ", \"max_distance\": %" PRIu64 ", \"dead_ends\": %" PRIu64 "}\n",
+		peak_rss, maze_arena_bytes(m), s->max_distance, s->dead_ends);
+}
+
+// ### batch
+
+// batch_job runs on every pool thread. Each worker builds one maze from the batch
+// configuration and reuses its memory for every maze it generates. Maze numbers are
+// handed out through a shared counter, so a worker that finishes early keeps taking
+// work until the batch is done.
+static void batch_job(void *arg, int worker, int workers) {
+	(void)worker; (void)workers; // mazes are handed out through batch->next
+	Batch *batch = (Batch*)arg;
+	Maze maze = *batch->config;
+	Maze *m = &maze;
+	m->threads = 1; // the batch already keeps every core busy
+	m->pool = NULL;
+	m->draw_live = false;
+	m->window = NULL;
+	double phase = monotonic_ms();
+	initialize(m);
+	double initialize_ms = lap_ms(&phase);
+	// mazes are rendered into the workers own buffer, only copying it out takes the lock
+	size_t str_size = get_maze_string_size(m);
+	char *str = (char*)arena_alloc(&m->arena, ALLOC_OUTPUT, str_size);
+	FILE *str_file = fmemopen(str, str_size, "w");
+	if(!str_file) die("Failed to allocate memory for maze string.", errno);
+
+	uint64_t i;
+	while((i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED)) < batch->count) {
+		clear_maze_links(m);
+		// maze i is the maze a single run with seed + i would give
+		m->seed = batch->config->seed + i;
+		rng_seed(&m->rng, m->seed);
+		// the worker initializes once, its first maze carries the time
+		// batch mazes are not solved for a path or exported
+		Maze_stats stats = { .number = i, .algorithm = algorithm_name(batch->generate), .skipped = 1u << PHASE_PATH | 1u << PHASE_EXPORT };
+		stats.ms[PHASE_INITIALIZE] = initialize_ms;
+		initialize_ms = 0;
+		phase = monotonic_ms();
+		generate_maze(m, batch->generate);
+		stats.ms[PHASE_GENERATE] = lap_ms(&phase);
+		uint64_t max_distance_cell = 0;
+		if(batch->print_distances || batch->stats) max_distance_cell = calculate_distances(m, 0);
+		stats.ms[PHASE_DISTANCES] = lap_ms(&phase);
+		rewind(str_file);
+		to_string(m, str_file, batch->print_distances);
+		fflush(str_file);
+		size_t length = ftell(str_file);
+		stats.ms[PHASE_TO_STRING] = lap_ms(&phase);
+		if(batch->stats) {
+			stats.max_distance = m->distance[max_distance_cell];
+			stats.dead_ends = dead_ends(m);
+		}
+		pthread_mutex_lock(&batch->out_lock);
+		fprintf(batch->out, "maze %" PRIu64 " seed %" PRIu64 "\n", i, m->seed);
+		fwrite(str, 1, length, batch->out);
+		if(batch->stats) write_stats(m, &stats, batch->stats);
+		pthread_mutex_unlock(&batch->out_lock);
+	}
+	fclose(str_file);
+	free_all(m);
+}
+
+// batch_mazes generates count mazes shaped like config on threads workers and
+// streams them to out, the order mazes appear in depends on thread timing.
+// With stats set, every maze also gets a line of json there, see write_stats().
+void batch_mazes(Maze *config, void (*generate)(Maze *m), uint64_t count, FILE *out, bool print_distances, FILE *stats) {
+	Batch batch = {
+		.config = config,
+		.generate = generate,
+		.count = count,
+		.next = 0,
+		.print_distances = print_distances,
+		.out = out,
+		.stats = stats
+	};
+
+	pthread_mutex_init(&batch.out_lock, NULL);
+
+	struct timespec start, stop;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	Pool *pool = pool_create(MAX(config->threads, 1));
+	pool_run(pool, batch_job, &batch);
+	pool_free(pool);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	pthread_mutex_destroy(&batch.out_lock);
+	double seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "Generated %" PRIu64 " mazes on %d threads in %.1f ms, %.0f mazes/s\n",
+		count, MAX(config->threads, 1), seconds * 1000.0, count / seconds);
+}
+
+
+
+// ### files
+
+// A maze file is a Maze_file_header followed by the east and the south wall set
+// exactly as they are kept in memory, two bits per cell, and optionally the
+// distance of every cell. Everything is little endian and 8 byte aligned, so
+// load_maze() can use the wall sets straight from the mapped file.
+
+// maze_file_size returns the bytes of a maze file holding m, or UINT64_MAX when
+// they do not fit in 64 bits, a size no file has
+static uint64_t maze_file_size(Maze *m, bool distances) {
+	uint64_t cell_count = size(m);
+	uint64_t words = cell_count / 64 + (cell_count % 64 != 0);
+	if(words > (UINT64_MAX - sizeof(Maze_file_header)) / (2 * sizeof(uint64_t))) return UINT64_MAX;
+	uint64_t size_bytes = sizeof(Maze_file_header) + 2 * words * sizeof(uint64_t);
+	if(distances) {
+		if(cell_count > (UINT64_MAX - size_bytes) / sizeof(uint32_t)) return UINT64_MAX;
+		size_bytes += cell_count * sizeof(uint32_t);
+	}
+	return size_bytes;
+}
+
+// save_maze writes m to path, with the distances of its cells if distances is set
+void save_maze(Maze *m, const char *path, const char *algorithm, bool distances) {
+	Maze_file_header header = {
+		.magic = MAZE_FILE_MAGIC,
+		.columns = m->columns,
+		.rows = m->rows,
+		.seed = m->seed,
+		.flags = distances ? MAZE_FILE_DISTANCES : 0
+	};
+	strncpy(header.algorithm, algorithm, sizeof(header.algorithm) - 1);
+	uint64_t words = BIT_WORDS(size(m));
+
+	FILE *file = fopen(path, "wb");
+	if(!file) die("Failed to open maze file for writing.", errno);
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(m->east_links, sizeof(uint64_t), words, file) == words
+		&& fwrite(m->south_links, sizeof(uint64_t), words, file) == words
+		&& (!distances || fwrite(m->distance, sizeof(uint32_t), size(m), file) == size(m));
+	if(fclose(file) != 0 || !ok) die("Failed to write maze file.", errno);
+}
+
+// walls_in_grid checks that no link leads out of the grid, which links() and
+// step() rely on, and that the padding bits after the last cell are clear
+static bool walls_in_grid(Maze *m) {
+	uint64_t cell_count = size(m);
+	uint64_t padded = BIT_WORDS(cell_count) * 64;
+	for(uint64_t row=0; row<m->rows; row++)
+		if(TEST_BIT(m->east_links, row * m->columns + m->columns - 1)) return false;
+	for(uint64_t c=cell_count; c<padded; c++)
+		if(TEST_BIT(m->east_links, c)) return false;
+	for(uint64_t c=cell_count - m->columns; c<padded; c++)
+		if(TEST_BIT(m->south_links, c)) return false;
+	return true;
+}
+
+// load_maze maps the maze file at path into m in place of initialize(). The wall
+// sets, and the distances if the file has them, point into the mapping, which is
+// private so the maze can still be changed without touching the file. Returns
+// whether the distances were loaded.
+bool load_maze(Maze *m, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) die("Failed to open maze file.", errno);
+	struct stat st;
+	if(fstat(fd, &st) != 0) die("Failed to read maze file.", errno);
+	if((size_t)st.st_size < sizeof(Maze_file_header)) die("Not a maze file.", EINVAL);
+	void *mapping = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(mapping == MAP_FAILED) die("Failed to map maze file.", errno);
+
+	Maze_file_header *header = (Maze_file_header*)mapping;
+	if(memcmp(header->magic, MAZE_FILE_MAGIC, sizeof(header->magic)) != 0) die("Not a maze file.", EINVAL);
+	if(header->columns < 2 || header->rows < 2 || header->columns > UINT64_MAX / header->rows) die("Maze file has an invalid size.", EINVAL);
+	m->columns = header->columns;
+	m->rows = header->rows;
+	m->seed = header->seed;
+	bool distances = (header->flags & MAZE_FILE_DISTANCES) != 0;
+	if((uint64_t)st.st_size != maze_file_size(m, distances)) die("Maze file is truncated.", EINVAL);
+
+	uint64_t cell_count = size(m);
+	arena_reset(&m->arena);
+	uint64_t *walls = (uint64_t*)((char*)mapping + sizeof(Maze_file_header));
+	m->mapping = mapping;
+	m->mapping_size = st.st_size;
+	m->east_links = walls;
+	m->south_links = walls + BIT_WORDS(cell_count);
+	if(!walls_in_grid(m)) die("Maze file has links out of the grid.", EINVAL);
+	if(distances) {
+		m->distance = (uint32_t*)(walls + 2 * BIT_WORDS(cell_count));
+	} else {
+		m->distance = (uint32_t*)arena_alloc(&m->arena, ALLOC_INITIALIZE, cell_count * sizeof(uint32_t));
+		memset(m->distance, 0xff, cell_count * sizeof(uint32_t));
+	}
+	m->marked = (uint64_t*)arena_calloc(&m->arena, ALLOC_INITIALIZE, BIT_WORDS(cell_count), sizeof(uint64_t));
+	m->path = (uint64_t*)arena_calloc(&m->arena, ALLOC_INITIALIZE, BIT_WORDS(cell_count), sizeof(uint64_t));
+	rng_seed(&m->rng, m->seed);
+	return distances;
+}
+
+// ### output
+
+// stream_eller writes a maze of m->columns made with Eller's algorithm to out as
+// text, a row at a time as it is generated. Endless streams never close the maze
+// and run until writing fails. Memory is a few arrays of columns.
+void stream_eller(Maze *m, FILE *out, bool endless) {
+	size_t line_length = m->columns * 4 + 2;
+	Arena_mark mark = arena_mark(&m->arena);
+	char *line = (char*)arena_alloc(&m->arena, ALLOC_OUTPUT, line_length);
+	Eller eller;
+	eller_start(&eller, &m->arena, m->columns);
+	rng_seed(&m->rng, m->seed);
+
+	line[0] = '+';
+	for(uint64_t co=0; co<m->columns; co++) memcpy(line + 1 + co*4, "---+", 4);
+	line[line_length-1] = '\n';
+	if(fwrite(line, 1, line_length, out) != line_length) die("Failed to write maze.", errno);
+
+	for(uint64_t ro=0; endless || ro<m->rows; ro++) {
+		eller_row(&eller, &m->rng, !endless && ro == m->rows-1);
+		line[0] = '|';
+		for(uint64_t co=0; co<m->columns; co++) memcpy(line + 1 + co*4, TEST_BIT(eller.east, co) ? "    " : "   |", 4);
+		if(fwrite(line, 1, line_length, out) != line_length) break;
+		line[0] = '+';
+		for(uint64_t co=0; co<m->columns; co++) memcpy(line + 1 + co*4, TEST_BIT(eller.south, co) ? "   +" : "---+", 4);
+		if(fwrite(line, 1, line_length, out) != line_length) break;
+	}
+	arena_release(&m->arena, mark);
+}
+
+size_t get_maze_string_size(Maze *m) {
+	size_t str_size = (m->columns * 4 + 1) * (m->rows * 2 + 1);
+	str_size += m->rows * 2 + 1; // for newlines, 1 after the top border and 2 for each row
+	str_size += 1;	      // for '\0'
+	return str_size;
+}
 
-			if (linked(c, c->south)) {
-				strcpy(bottom_header, "   +");
-			} else {
-				strcpy(bottom_header, "---+");
+// the returned array lives in the maze's arena until the maze is initialized again or freed
+uint64_t *path_to(Maze *m, uint64_t goal, uint64_t max_path) {
+	if(m->distance[goal] == NO_DISTANCE) die("Trying to find closest path before solving maze.", errno);
+	uint64_t current = goal;
+	uint64_t *breadcrumbs = (uint64_t*)arena_alloc(&m->arena, ALLOC_PATH_TO, (max_path+1) * sizeof(uint64_t));
+	uint64_t breadcrumbs_counter = 0;
+	breadcrumbs[breadcrumbs_counter++] = current;
+	SET_BIT(m->path, current);
+	while(m->distance[current] > 0 && breadcrumbs_counter <= max_path) {
+		uint32_t lowest = m->distance[current];
+		uint64_t candidate = current;
+		uint8_t l = links(m, current);
+		for(enum Direction d=NORTH; d<=WEST; d<<=1) {
+			if(!(l & d)) continue;
+			uint64_t n = step(m, current, d);
+			if(m->distance[n] < lowest) {
+				lowest = m->distance[n];
+				candidate = n;
 			}
-			bottom_header += 4;
 		}
+		breadcrumbs[breadcrumbs_counter++] = candidate;
+		SET_BIT(m->path, candidate);
+		current = candidate;
+	}
+	return breadcrumbs;
+}
 
-		strcpy(str_header, top);
-		str_header += line_length;
-		strcpy(str_header, "\n");
-		str_header++;
+// cell_text writes the four characters of cell c in its row line: the cell body,
+// its distance or dead end marker, and the wall or gap to the east
+static inline void cell_text(Maze *m, uint64_t c, bool print_distances, char *out) {
+	out[3] = TEST_BIT(m->east_links, c) ? ' ' : '|';
+	if(!print_distances) {
+		out[0] = ' ';
+		out[1] = TEST_BIT(m->marked, c) ? '*' : ' ';
+		out[2] = ' ';
+		return;
+	}
+	uint32_t d = m->distance[c];
+	if(d < 100) {
+		out[0] = d < 10 ? ' ' : '0' + d / 10;
+		out[1] = '0' + d % 10;
+		out[2] = TEST_BIT(m->path, c) ? '*' : ' ';
+	} else if(d < 1000) {
+		// three digits leave no room for the path marker
+		out[0] = '0' + d / 100;
+		out[1] = '0' + d / 10 % 10;
+		out[2] = '0' + d % 10;
+	} else {
+		memcpy(out, "###", 3);
+	}
+}
 
-		strcpy(str_header, bottom);
-		str_header += line_length;
-		strcpy(str_header, "\n");
-		str_header++;
+// to_string writes the maze as text to out. Rows are rendered into a reusable
+// buffer with plain byte stores and written out in large blocks, so memory only
+// grows with the number of columns.
+void to_string(Maze *m, FILE *out, bool print_distances) {
+	size_t line_length = m->columns * 4 + 2; // with '\n'
+	size_t buffer_size = MAX((size_t)RENDER_BUFFER, 2 * line_length);
+	Arena_mark mark = arena_mark(&m->arena);
+	char *buffer = (char*)arena_alloc(&m->arena, ALLOC_OUTPUT, buffer_size);
+
+	char *line = buffer;
+	*line++ = '+';
+	for(uint64_t col=0; col<m->columns; col++, line+=4) memcpy(line, "---+", 4);
+	*line++ = '\n';
+
+	for(uint64_t row=0; row<m->rows; row++) {
+		if((size_t)(buffer + buffer_size - line) < 2 * line_length) {
+			if(fwrite(buffer, 1, line - buffer, out) != (size_t)(line - buffer)) die("Failed to write maze.", errno);
+			line = buffer;
+		}
+		uint64_t c = index_at(m, 0, row);
+		*line++ = '|';
+		for(uint64_t col=0; col<m->columns; col++, line+=4) cell_text(m, c + col, print_distances, line);
+		*line++ = '\n';
+		*line++ = '+';
+		for(uint64_t col=0; col<m->columns; col++, line+=4) memcpy(line, TEST_BIT(m->south_links, c + col) ? "   +" : "---+", 4);
+		*line++ = '\n';
 	}
+	if(fwrite(buffer, 1, line - buffer, out) != (size_t)(line - buffer)) die("Failed to write maze.", errno);
+	arena_release(&m->arena, mark);
 }
 
-void draw_start() {
+// draw_cell redraws the tile of cell c in the live view: its floor, red if it is the
+// focus, and the four walls around it, corners are always drawn as posts
+static void draw_cell(Maze *m, uint64_t c) {
+	int s = m->live.cell_size;
+	int x = (int)column(m, c) * s;
+	int y = (int)row(m, c) * s;
+	uint8_t l = links(m, c);
+	tigrFill(m->window, x+1, y+1, s-1, s-1, c == m->live.focus ? Red : White);
+	tigrFill(m->window, x, y, s+1, 1, (l & NORTH) ? White : Black);
+	tigrFill(m->window, x, y+s, s+1, 1, (l & SOUTH) ? White : Black);
+	tigrFill(m->window, x, y, 1, s+1, (l & WEST) ? White : Black);
+	tigrFill(m->window, x+s, y, 1, s+1, (l & EAST) ? White : Black);
+	tigrFill(m->window, x, y, 1, 1, Black);
+	tigrFill(m->window, x+s, y, 1, 1, Black);
+	tigrFill(m->window, x, y+s, 1, 1, Black);
+	tigrFill(m->window, x+s, y+s, 1, 1, Black);
+}
+
+// draw_present redraws the tiles changed since the last frame and shows the frame
+static void draw_present(Maze *m) {
+	Live_view *live = &m->live;
+	for(uint64_t i=0; i<live->dirty_cells.count; i++) {
+		uint64_t c = live->dirty_cells.cells[i];
+		CLEAR_BIT(live->dirty, c);
+		draw_cell(m, c);
+	}
+	live->dirty_cells.count = 0;
+	tigrUpdate(m->window);
+	clock_gettime(CLOCK_MONOTONIC, &live->last_frame);
+}
+
+// draw_start opens a window sized to the maze, with cells as large as fit on screen,
+// and draws every wall once. After that only changed tiles are redrawn.
+void draw_start(Maze *m) {
 #ifdef MAZE_TIGR
 
-	int win_width = WINDOW_WIDTH;
-	int win_height = WINDOW_HEIGHT;
-	Window = tigrWindow(win_width, win_height, "Maze", 0);
-	if(!Window) die("Failed to create tigrWindow.", errno);
+	Live_view *live = &m->live;
+	uint64_t longest = MAX(m->columns, m->rows);
+	live->cell_size = (int)MAX(2, MIN(LIVE_CELL_SIZE, LIVE_WINDOW_SIZE / longest));
+	live->focus = NO_CELL;
+	// an arena of its own, generators release their scratch while the view is still in use
+	live->dirty = (uint64_t*)arena_calloc(&live->arena, ALLOC_LIVE_VIEW, BIT_WORDS(size(m)), sizeof(uint64_t));
+	live->dirty_cells = (Cell_stack){ .arena = &live->arena };
+	m->window = tigrWindow((int)m->columns * live->cell_size + 1, (int)m->rows * live->cell_size + 1, "Maze", 0);
+	if(!m->window) die("Failed to create tigrWindow.", errno);
+
+	tigrClear(m->window, White);
+	uint64_t cell_count = size(m);
+	for(uint64_t i=0; i<cell_count; i++) draw_cell(m, i);
+	draw_present(m);
 
 #endif
 }
 
-void draw_update(int slow, Cell *focus) {
+// draw_update shows a generator step. Normally every step is a frame followed by a
+// pause of slow. With a frame budget steps are collected until the budget has passed
+// and then shown in one frame without pausing.
+void draw_update(Maze *m, int slow, uint64_t focus) {
 #ifdef MAZE_TIGR
-	int cell_count = size();
-	int cell_size = 8;
-	int win_width = WINDOW_WIDTH;
-	int win_height = WINDOW_HEIGHT;
-	int half_cell_size = cell_size/2;
-	int img_width = Columns * cell_size;
-	int img_height = Rows * cell_size;
-	int offx = (win_width-img_width)/2;
-	int offy = (win_height-img_height)/2;
-	
-	tigrClear(Window, White);
-	for(int i=0; i<cell_count; i++) {
-		Cell *c = Grid[i];
-		int x1 = (column(i) * cell_size) + offx;
-		int y1 = (row(i) * cell_size) + offy;
-		int x2 = (column(i)+1) * cell_size + offx;
-		int y2 = (row(i)+1) * cell_size + offy;
-		if(!c->north) tigrLine(Window, x1,y1,x2,y1,Black); // north edge
-		if(!c->west) tigrLine(Window, x1,y1,x1,y2,Black); // western edge
-		if(!linked(c, c->east)) tigrLine(Window,x2,y1,x2,y2+1,Black);
-		if(!linked(c, c->south)) tigrLine(Window,x1,y2,x2,y2,Black);
-	}
 
-	if(focus) {
-		int x = (focus->column * cell_size) + half_cell_size + offx;
-		int y = (focus->row * cell_size) + half_cell_size + offy;
-		tigrFillCircle(Window,x,y,3,Red);
+	Live_view *live = &m->live;
+	if(focus != live->focus) {
+		mark_dirty(m, live->focus);
+		live->focus = focus;
+		mark_dirty(m, focus);
+	}
+	if(live->frame_budget_ms > 0) {
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		int64_t elapsed_ms = (now.tv_sec - live->last_frame.tv_sec) * 1000 + (now.tv_nsec - live->last_frame.tv_nsec) / 1000000;
+		if(elapsed_ms < live->frame_budget_ms) return;
+		draw_present(m);
+	} else {
+		draw_present(m);
+		usleep(slow * 10000);
 	}
-
-	tigrUpdate(Window);
-	usleep(slow * 10000);
 
 #endif
 }
 
-void draw_end() {
+void draw_end(Maze *m) {
 #ifdef MAZE_TIGR
 
-	if(!Window) return;
-	while (!tigrClosed(Window) && !tigrKeyDown(Window, TK_ESCAPE)) { 
-		//usleep(1*100000);
-		tigrPrint(Window, tfont, 10, 10, tigrRGB(0xff, 0xff, 0xff), "Done");
-		tigrUpdate(Window);
+	if(!m->window) return;
+	// the last steps of a frame budget may not have been shown yet
+	mark_dirty(m, m->live.focus);
+	m->live.focus = NO_CELL;
+	draw_present(m);
+	while (!tigrClosed(m->window) && !tigrKeyDown(m->window, TK_ESCAPE)) {
+		usleep(DRAW_IDLE_SLEEP);
+		tigrPrint(m->window, tfont, 10, 10, tigrRGB(0xff, 0xff, 0xff), "Done");
+		tigrUpdate(m->window);
 	}
-	if(Window) tigrFree(Window);
-	
+	if(m->window) tigrFree(m->window);
+	arena_free(&m->live.arena);
+	m->live.dirty = NULL;
+	m->live.dirty_cells = (Cell_stack){0};
+
 #endif
 }
 
-void draw(Cell **grid, Cell **breadcrumbs, int max_distance) {
+// draw_layer renders the cells seen through a view at view_x, view_y in maze pixels
+// into layer: the distance shading, the walls, the solution line and, when cells are
+// large enough to hold them, the distances along the solution. Work is bounded by the
+// window, not the maze.
+static void draw_layer(Maze *m, Tigr *layer, int max_distance, int cell_size, int64_t view_x, int64_t view_y) {
+	int half_cell_size = cell_size/2;
+	tigrClear(layer, White);
+	uint64_t col_first = (uint64_t)MAX(view_x / cell_size, 0);
+	uint64_t row_first = (uint64_t)MAX(view_y / cell_size, 0);
+	uint64_t col_end = (uint64_t)MIN(MAX((view_x + layer->w) / cell_size + 1, 0), (int64_t)m->columns);
+	uint64_t row_end = (uint64_t)MIN(MAX((view_y + layer->h) / cell_size + 1, 0), (int64_t)m->rows);
+
+	// draw walls
+	for(uint64_t ro=row_first; ro<row_end; ro++) {
+		for(uint64_t co=col_first; co<col_end; co++) {
+			uint64_t i = index_at(m, co, ro);
+			int x1 = (int)((int64_t)co * cell_size - view_x);
+			int y1 = (int)((int64_t)ro * cell_size - view_y);
+			int x2 = x1 + cell_size;
+			int y2 = y1 + cell_size;
+			tigrFillRect(layer, x1, y1, cell_size+2, cell_size+2, color_grid_distance(m, i, max_distance));
+			if(ro == 0) tigrLine(layer, x1,y1,x2,y1,Black); // north edge
+			if(co == 0) tigrLine(layer, x1,y1,x1,y2,Black); // western edge
+			if(!linked_to(m, i, EAST)) tigrLine(layer,x2,y1,x2,y2+1,Black);
+			if(!linked_to(m, i, SOUTH)) tigrLine(layer,x1,y2,x2,y2,Black);
+		}
+	}
+	// draw solution line and distances from the path bits of the cells in view, each
+	// path cell draws half of the line to every linked neighbour on the path
+	for(uint64_t ro=row_first; ro<row_end; ro++) {
+		for(uint64_t co=col_first; co<col_end; co++) {
+			uint64_t i = index_at(m, co, ro);
+			if(!TEST_BIT(m->path, i)) continue;
+			int x = (int)((int64_t)co * cell_size + half_cell_size - view_x);
+			int y = (int)((int64_t)ro * cell_size + half_cell_size - view_y);
+			uint8_t l = links(m, i);
+			for(enum Direction d=NORTH; d<=WEST; d<<=1) {
+				if(!(l & d) || !TEST_BIT(m->path, step(m, i, d))) continue;
+				int dx = (d == EAST) ? half_cell_size : (d == WEST) ? -half_cell_size : 0;
+				int dy = (d == SOUTH) ? half_cell_size : (d == NORTH) ? -half_cell_size : 0;
+				tigrLine(layer, x, y, x+dx, y+dy, Red);
+			}
+		}
+	}
+	if(cell_size < DRAW_TEXT_CELL_SIZE) return;
+	for(uint64_t ro=row_first; ro<row_end; ro++) {
+		for(uint64_t co=col_first; co<col_end; co++) {
+			uint64_t i = index_at(m, co, ro);
+			if(!TEST_BIT(m->path, i)) continue;
+			int x = (int)((int64_t)co * cell_size + half_cell_size - view_x);
+			int y = (int)((int64_t)ro * cell_size + half_cell_size - view_y);
+			char str[12];
+			sprintf(str, "%" PRIu32, m->distance[i]);
+			int text_width_half = tigrTextWidth(tfont, str)/2;
+			int text_height_half = tigrTextHeight(tfont, str)/2;
+			tigrPrint(layer, tfont, x-text_width_half, y-text_height_half, tigrRGB(0xff, 0xff, 0xff), str);
+		}
+	}
+}
+
+// draw shows the solved maze in a window. The maze is rendered once into an offscreen
+// layer that is blitted every frame, and only rendered again when the arrow keys pan
+// or +/- zoom the view. Without input the loop sleeps between frames.
+void draw(Maze *m, int max_distance) {
 #ifdef MAZE_TIGR
 
-	int win_width = 320;
-	int win_height = 240;
-	
+	int win_width = DRAW_WIDTH;
+	int win_height = DRAW_HEIGHT;
+
 	Tigr* screen = tigrWindow(win_width, win_height, "Maze", 0);
-	
+	if(!screen) die("Failed to create tigrWindow.", errno);
+	Tigr* layer = tigrBitmap(win_width, win_height);
+	if(!layer) die("Failed to create maze layer.", errno);
+
+	// the view starts centred on the maze, view_x and view_y are in maze pixels
 	int cell_size = 8;
-	int half_cell_size = cell_size/2;
-	
-	int img_width = Columns * cell_size;
-	int img_height = Rows * cell_size;
-	
-	int offx = (win_width-img_width)/2;
-	int offy = (win_height-img_height)/2;
+	int64_t view_x = ((int64_t)m->columns * cell_size - win_width) / 2;
+	int64_t view_y = ((int64_t)m->rows * cell_size - win_height) / 2;
 
-	int cell_count = Columns * Rows;
-	bool is_not_saved = true;
+	bool render = true;
 	while (!tigrClosed(screen) && !tigrKeyDown(screen, TK_ESCAPE)) {
-		tigrClear(screen, White);
-		// draw walls
-		for(int i=0; i<cell_count; i++) {
-			Cell *c = grid[i];
-			int x1 = (column(i) * cell_size) + offx;
-			int y1 = (row(i) * cell_size) + offy;
-			int x2 = (column(i)+1) * cell_size + offx;
-			int y2 = (row(i)+1) * cell_size + offy;
-			tigrFillRect(screen, x1, y1, cell_size+2, cell_size+2, color_grid_distance(c, max_distance));
-			if(!c->north) tigrLine(screen, x1,y1,x2,y1,Black); // north edge
-			if(!c->west) tigrLine(screen, x1,y1,x1,y2,Black); // western edge
-			if(!linked(c, c->east)) tigrLine(screen,x2,y1,x2,y2+1,Black);
-			if(!linked(c, c->south)) tigrLine(screen,x1,y2,x2,y2,Black);
-		}		
-		// draw solution line
-		int i=0;
-		while(breadcrumbs[i+1] && breadcrumbs[i]->distance>0) {
-			Cell *c = breadcrumbs[i];
-			int x1 = (breadcrumbs[i]->column * cell_size) + half_cell_size + offx;
-			int y1 = (breadcrumbs[i]->row * cell_size) + half_cell_size + offy;
-			int x2 = (breadcrumbs[i+1]->column * cell_size) + half_cell_size + offx;
-			int y2 = (breadcrumbs[i+1]->row * cell_size) + half_cell_size + offy;
-			tigrLine(screen,x1,y1,x2,y2,Red);
-			i++;
-		}
-		// print breadcrumb distances
-		for(i=breadcrumbs[0]->distance; i>=0; i--) {
-			int x1 = (breadcrumbs[i]->column * cell_size) + half_cell_size + offx;
-			int y1 = (breadcrumbs[i]->row * cell_size) + half_cell_size + offy;
-			char str[4];
-			sprintf(str, "%d", breadcrumbs[i]->distance);
-			int text_width_half = tigrTextWidth(tfont, str)/2;
-			int text_height_half = tigrTextHeight(tfont, str)/2;
-			tigrPrint(screen, tfont, x1-text_width_half, y1-text_height_half, tigrRGB(0xff, 0xff, 0xff), str);
+		int64_t step = MAX(cell_size, DRAW_PAN_STEP);
+		if(tigrKeyHeld(screen, TK_LEFT)) { view_x -= step; render = true; }
+		if(tigrKeyHeld(screen, TK_RIGHT)) { view_x += step; render = true; }
+		if(tigrKeyHeld(screen, TK_UP)) { view_y -= step; render = true; }
+		if(tigrKeyHeld(screen, TK_DOWN)) { view_y += step; render = true; }
+		int zoom = cell_size;
+		if((tigrKeyDown(screen, TK_EQUALS) || tigrKeyDown(screen, TK_PADADD)) && cell_size < DRAW_MAX_CELL_SIZE) zoom = cell_size * 2;
+		if((tigrKeyDown(screen, TK_MINUS) || tigrKeyDown(screen, TK_PADSUB)) && cell_size > 1) zoom = cell_size / 2;
+		if(zoom != cell_size) {
+			// zoom around the centre of the window
+			view_x = (view_x + win_width/2) * zoom / cell_size - win_width/2;
+			view_y = (view_y + win_height/2) * zoom / cell_size - win_height/2;
+			cell_size = zoom;
+			render = true;
 		}
-		tigrUpdate(screen);
-		if(Save_to_file_flag && is_not_saved) {
-			printf("Saving file ...\n");
-			int save_check = tigrSaveImage("./maze_image.png", screen);
-			if(save_check == 0) die("Failed to save image to file.", errno);
-			is_not_saved = false;
+
+		bool idle = !render;
+		if(render) {
+			draw_layer(m, layer, max_distance, cell_size, view_x, view_y);
+			render = false;
 		}
+		tigrBlit(screen, layer, 0, 0, 0, 0, win_width, win_height);
+		tigrUpdate(screen);
+		if(idle) usleep(DRAW_IDLE_SLEEP);
 	}
 
+	tigrFree(layer);
 	tigrFree(screen);
 
 #endif
 }
 
-TPixel color_grid_distance(Cell *cell, int max) {
-	if(!cell->solved) return White;
-	float dist_f = (float)cell->distance;
+TPixel color_grid_distance(Maze *m, uint64_t cell, int max) {
+
+	if(m->distance[cell] == NO_DISTANCE) return White;
+	float dist_f = (float)m->distance[cell];
 	float max_f = (float)max;
 	float intensity_f = (max_f - dist_f)/max_f;
 	int dark = (int)(255.0 * intensity_f);
@@ -914,24 +2613,180 @@ TPixel color_grid_distance(Cell *cell, int max) {
 	return col;
 }
 
+// ### image
+
+// Images are rasterized one pixel row at a time straight from the wall sets, so
+// nothing but a row of pixels is ever held in memory and no window is needed.
+// Every cell is cell_size pixels wide, walls are one pixel lines on the cell edges.
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t n) {
+	if(!crc_table[1]) {
+		for(uint32_t i=0; i<256; i++) {
+			uint32_t c = i;
+			for(int k=0; k<8; k++) c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			crc_table[i] = c;
+		}
+	}
+	crc = ~crc;
+	for(size_t i=0; i<n; i++) crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void put_u32(uint8_t *out, uint32_t v) {
+	out[0] = v >> 24;
+	out[1] = v >> 16;
+	out[2] = v >> 8;
+	out[3] = v;
+}
+
+static void png_chunk(FILE *file, const char *type, const uint8_t *data, size_t length) {
+	uint8_t head[8];
+	uint8_t tail[4];
+	put_u32(head, (uint32_t)length);
+	memcpy(head + 4, type, 4);
+	put_u32(tail, crc32_update(crc32_update(0, head + 4, 4), data, length));
+	if(fwrite(head, 1, 8, file) != 8 || fwrite(data, 1, length, file) != length || fwrite(tail, 1, 4, file) != 4)
+		die("Failed to write image.", errno);
+}
+
+// image_scanline draws pixel row y: the walls, the distance shading of each cell and
+// the solution path through the cell centres. Pixel rows on a cell edge hold its north walls.
+static void image_scanline(Maze *m, uint64_t y, int cell_size, uint32_t max_distance, uint8_t *rgb) {
+	uint64_t width = m->columns * cell_size + 1;
+	if(y == m->rows * cell_size) {
+		memset(rgb, 0, width * 3); // southern edge
+		return;
+	}
+	uint64_t ro = y / cell_size;
+	int k = y % cell_size;
+	int half = cell_size / 2;
+	for(uint64_t co=0; co<m->columns; co++) {
+		uint64_t c = index_at(m, co, ro);
+		TPixel shade = color_grid_distance(m, c, max_distance);
+		uint8_t *px = rgb + co * cell_size * 3;
+		bool open = (k == 0) ? (ro > 0 && TEST_BIT(m->south_links, c - m->columns)) : true;
+		for(int x=0; x<cell_size; x++) {
+			bool wall = (k == 0 && (x == 0 || !open)) || (x == 0 && !(co > 0 && TEST_BIT(m->east_links, c - 1)));
+			px[x*3] = wall ? 0 : shade.r;
+			px[x*3+1] = wall ? 0 : shade.g;
+			px[x*3+2] = wall ? 0 : shade.b;
+		}
+		if(!TEST_BIT(m->path, c)) continue;
+		// the path runs from the cell centre to every linked neighbour that is on it too
+		int from = cell_size, to = -1;
+		if(k == half) {
+			from = to = half;
+			if(co > 0 && TEST_BIT(m->east_links, c - 1) && TEST_BIT(m->path, c - 1)) from = 0;
+			if(TEST_BIT(m->east_links, c) && TEST_BIT(m->path, c + 1)) to = cell_size - 1;
+		} else if(k < half && ro > 0 && TEST_BIT(m->south_links, c - m->columns) && TEST_BIT(m->path, c - m->columns)) {
+			from = to = half;
+		} else if(k > half && TEST_BIT(m->south_links, c) && TEST_BIT(m->path, c + m->columns)) {
+			from = to = half;
+		}
+		for(int x=from; x<=to; x++) {
+			px[x*3] = Red.r;
+			px[x*3+1] = Red.g;
+			px[x*3+2] = Red.b;
+		}
+	}
+	memset(rgb + (width - 1) * 3, 0, 3); // eastern edge
+}
+
+// save_image writes the maze as a PPM if path ends in .ppm and as a PNG otherwise.
+// The PNG is not compressed: its pixel rows go out as stored deflate blocks, one
+// IDAT chunk per row, which keeps writing as fast as the disk.
+void save_image(Maze *m, const char *path, uint32_t max_distance, int cell_size) {
+	uint64_t width = m->columns * cell_size + 1;
+	uint64_t height = m->rows * cell_size + 1;
+	size_t ext = strlen(path);
+	bool png = !(ext >= 4 && strcmp(path + ext - 4, ".ppm") == 0);
+	if(png && (width > INT32_MAX || height > INT32_MAX)) die("Maze too large for a PNG image.", EOVERFLOW);
+
+	// a scanline is a filter byte and the pixels, stored in blocks of at most 65535 bytes
+	size_t line_length = 1 + width * 3;
+	size_t blocks = (line_length + 65534) / 65535;
+	Arena_mark mark = arena_mark(&m->arena);
+	uint8_t *chunk = (uint8_t*)arena_alloc(&m->arena, ALLOC_OUTPUT, line_length + blocks * 5);
+	uint8_t *line = (uint8_t*)arena_alloc(&m->arena, ALLOC_OUTPUT, line_length);
+	FILE *file = fopen(path, "wb");
+	if(!file) die("Failed to open image file.", errno);
+
+	if(png) {
+		uint8_t header[13] = {0};
+		put_u32(header, (uint32_t)width);
+		put_u32(header + 4, (uint32_t)height);
+		header[8] = 8; // bits per channel
+		header[9] = 2; // rgb
+		fwrite("\x89PNG\r\n\x1a\n", 1, 8, file);
+		png_chunk(file, "IHDR", header, sizeof(header));
+		png_chunk(file, "IDAT", (const uint8_t*)"\x78\x01", 2); // zlib header
+	} else {
+		fprintf(file, "P6\n%" PRIu64 " %" PRIu64 "\n255\n", width, height);
+	}
+
+	uint32_t adler_a = 1, adler_b = 0;
+	for(uint64_t y=0; y<height; y++) {
+		line[0] = 0; // no filter
+		image_scanline(m, y, cell_size, max_distance, line + 1);
+		if(!png) {
+			if(fwrite(line + 1, 1, line_length - 1, file) != line_length - 1) die("Failed to write image.", errno);
+			continue;
+		}
+		uint8_t *out = chunk;
+		for(size_t done=0; done<line_length; ) {
+			size_t n = MIN(line_length - done, (size_t)65535);
+			*out++ = 0; // stored block, not the last one
+			*out++ = n & 0xff;
+			*out++ = n >> 8;
+			*out++ = ~n & 0xff;
+			*out++ = (~n >> 8) & 0xff;
+			memcpy(out, line + done, n);
+			out += n;
+			done += n;
+		}
+		for(size_t i=0; i<line_length; i++) {
+			adler_a += line[i];
+			if(adler_a >= 65521) adler_a -= 65521;
+			adler_b += adler_a;
+			if(adler_b >= 65521) adler_b -= 65521;
+		}
+		png_chunk(file, "IDAT", chunk, out - chunk);
+	}
+
+	if(png) {
+		uint8_t end[9] = {1, 0, 0, 0xff, 0xff}; // empty last block, then the adler32 checksum
+		put_u32(end + 5, (adler_b << 16) | adler_a);
+		png_chunk(file, "IDAT", end, sizeof(end));
+		png_chunk(file, "IEND", NULL, 0);
+	}
+	if(fclose(file) != 0) die("Failed to write image.", errno);
+	arena_release(&m->arena, mark);
+}
+
 // end output
 
 
 
-void free_all() {
-	if(!Grid) return;
-	int cell_count = size();
-	for(int i=0; i<cell_count; i++) {
-		if(Grid[i]->links) 
-			free(Grid[i]->links);
-		if(Grid[i]) 
-			free(Grid[i]);
+// free_all gives the arena's chunks back, and unmaps the maze file if there is one
+void free_all(Maze *m) {
+	if(m->mapping) {
+		munmap(m->mapping, m->mapping_size);
+		m->mapping = NULL;
 	}
-	free(Grid);
+	pool_free(m->pool);
+	m->pool = NULL;
+	arena_free(&m->arena);
+	arena_free(&m->live.arena);
+	m->east_links = m->south_links = NULL;
+
+	m->distance = NULL;
+	m->marked = NULL;
+	m->path = NULL;
 }
 
 void die(char *e, int n) {
 	printf("%s %s %s", e, "Exiting program.\n", strerror(n));
-	free_all();
 	exit(EXIT_FAILURE);
 }
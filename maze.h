@@ -1,45 +1,264 @@
+#ifdef __linux__
+#define _GNU_SOURCE // for pinning pool threads to CPUs
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <errno.h>
 #include <time.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
 #include "tigr/tigr.h"
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
 
-// A single cell in the maze, with links and neighbours.
-typedef struct Cell {
-	uint8_t column;
-	uint8_t row;
-	struct Cell *north;
-	struct Cell *south;
-	struct Cell *east;
-	struct Cell *west;
-	struct Cell **links;
-	int links_size; // allocated in memory
-	int links_count; // numnber of links currently connected to this cell
-	bool solved; // true if distance is calculated for this cell
-	int distance; // distance in steps from root
-	char marker;
-	bool junction;
-	bool path; // currently solved path
-} Cell;
-
-typedef struct Cell_node {
-	struct Cell_node *next;
-	Cell *cell;
-	int index;
-} Cell_node;
+// Cells are addressed by their index in the grid, see index_at().
+// Walls are stored in two packed bitsets, one bit per cell each:
+// a set bit in the east set means the cell is linked to its eastern
+// neighbour, a set bit in the south set means it is linked to the cell below.
+// Per-cell distance lives in a parallel array, markers and the solved path
+// in bitsets of the same layout. Indices are 64 bit so grids can hold
+// billions of cells.
+#define NO_CELL UINT64_MAX
+#define NO_DISTANCE UINT32_MAX
+
+// Directions from a cell to its neighbours, usable as bit mask.
+enum Direction {
+	NORTH = 1,
+	SOUTH = 2,
+	EAST = 4,
+	WEST = 8
+};
+
+// State of a xoshiro256** random generator, seeded with rng_seed().
+typedef struct Rng {
+	uint64_t s[4];
+} Rng;
+
+// Four xoshiro256** generators stepped together with vector instructions.
+typedef uint64_t Rng_vector __attribute__((vector_size(32)));
+typedef struct Rng_lanes {
+	Rng_vector s[4];
+} Rng_lanes;
+
+// Helpers that allocate memory, each allocation is counted for its site, see counted_malloc()
+enum Alloc_site {
+	ALLOC_ARENA,         // chunks arenas take from malloc
+	ALLOC_INITIALIZE,    // wall sets and per cell arrays
+	ALLOC_GENERATOR,     // scratch arrays of the generators
+	ALLOC_STACK,         // stack_push growing a Cell_stack
+	ALLOC_ELLER,
+	ALLOC_GENERATE_MAZE, // band generators of parallel generation
+	ALLOC_POOL,
+	ALLOC_DISTANCES,
+	ALLOC_PATH_TO,
+	ALLOC_OUTPUT,        // text, stream, batch and image buffers
+	ALLOC_LIVE_VIEW,
+	ALLOC_SITES
+};
+
+typedef struct Alloc_count {
+	uint64_t mallocs;  // malloc and calloc calls
+	uint64_t frees;
+	uint64_t arena;    // allocations served by an arena
+	uint64_t bytes;    // requested by all of them
+} Alloc_count;
+
+// A bump allocator that owns all memory of one maze: the wall sets, the per cell
+// arrays and the scratch memory of generators and solvers. Scratch is given back
+// with arena_release(), everything at once with arena_reset().
+typedef struct Arena_chunk {
+	struct Arena_chunk *next;
+	size_t size;   // bytes in data
+	size_t used;
+	size_t mapped; // length of the mapping for chunks on huge pages, 0 for malloc
+	unsigned char data[];
+} Arena_chunk;
+
+// Pages for chunks of at least HUGE_PAGE_SIZE, the grid arrays of large mazes
+enum Page_mode {
+	PAGES_DEFAULT,     // malloc
+	PAGES_TRANSPARENT, // mmap with madvise(MADV_HUGEPAGE)
+	PAGES_HUGETLB      // mmap from the reserved huge pages
+};
+
+typedef struct Arena {
+	Arena_chunk *first;
+	Arena_chunk *current; // chunks after it are empty
+	enum Page_mode pages;
+	bool hugetlb_fallback; // no reserved huge pages were left, transparent ones were used
+} Arena;
+
+// A position in an arena, see arena_mark()
+typedef struct Arena_mark {
+	Arena_chunk *chunk;
+	size_t used;
+} Arena_mark;
+
+// A growable array of cell indices used as a stack, kept in an arena.
+typedef struct Cell_stack {
+	uint64_t *cells;
+	uint64_t count;
+	uint64_t capacity;
+	Arena *arena;
+} Cell_stack;
+
+// State of the live view drawn while a maze is generated with -l.
+typedef struct Live_view {
+	uint64_t *dirty;        // bit set: tile changed since the last frame
+	Cell_stack dirty_cells; // the same cells in a list, so frames only visit them
+	Arena arena;            // memory of the view, freed by draw_end()
+	uint64_t focus;         // cell drawn in red
+	int cell_size;
+	int frame_budget_ms;    // when set, one frame per budget instead of one per step
+	struct timespec last_frame;
+} Live_view;
+
+// A maze and everything needed to generate, solve and draw it. Functions only
+// touch the maze they are given, so independent mazes can be worked on in parallel.
+typedef struct Maze {
+	uint64_t columns;
+	uint64_t rows;
+	uint64_t *east_links;  // bit set: cell is linked to its eastern neighbour
+	uint64_t *south_links; // bit set: cell is linked to its southern neighbour
+	uint32_t *distance;    // distance in steps from root, NO_DISTANCE if not solved
+	uint64_t *marked;      // bit set: cell is marked, e.g. as a dead end
+	uint64_t *path;        // bit set: cell is on the currently solved path
+	int threads;           // worker threads the maze may use when generating and solving
+	struct Pool *pool;     // those threads, started on first use, see maze_pool()
+	uint64_t seed;         // initialize() seeds rng with it, same seed gives the same maze
+	Rng rng;
+	bool draw_live;        // animate the generator in window
+	Live_view live;
+	Arena arena;           // memory of everything above, see arena_alloc()
+	bool parallel_solve;   // solve large grids on all threads, see calculate_distances_parallel()
+	bool bands;            // cut large grids into row bands for every algorithm, see generate_maze()
+	bool first_touch;      // place bands of parallel generated grids on the NUMA node of their thread
+	void *mapping;         // maze file the wall sets are mapped from, see load_maze()
+	size_t mapping_size;
+	Tigr *window;
+} Maze;
+
+// Header of a binary maze file, see save_maze()
+#define MAZE_FILE_MAGIC "MAZEBIN1"
+#define MAZE_FILE_DISTANCES 1 // flag: the distance section follows the wall sets
+
+typedef struct Maze_file_header {
+	char magic[8];
+	uint64_t columns;
+	uint64_t rows;
+	uint64_t seed;
+	uint64_t flags;
+	char algorithm[32];
+} Maze_file_header;
+
+typedef struct Algorithm {
+	const char *name;
+	void (*generate)(Maze *m);
+} Algorithm;
+
+// Every generator by name, used by -t, saved maze files and the benchmark
+extern const Algorithm Algorithms[];
+extern const size_t Algorithms_count;
+
+
+// Eller's algorithm keeps only the current row, every array has one entry per column.
+typedef struct Eller {
+	uint64_t columns;
+	uint64_t *set;     // set of each cell in the current row
+	uint64_t *parent;  // union find over the sets while the row is joined
+	uint64_t *members; // cells per set
+	uint64_t *east;    // bit set: cell is linked east in the current row
+	uint64_t *south;   // bit set: cell is linked to the row below
+} Eller;
 
-typedef struct Stack_control {
-	struct Stack_control* next;
-	void* data;
+// Hardware counters read around a profiled run, see profile_start()
+enum Profile_counter {
+	PROFILE_CYCLES,
+	PROFILE_INSTRUCTIONS,
+	PROFILE_L1D_MISSES,
+	PROFILE_LLC_MISSES,
+	PROFILE_BRANCH_MISSES,
+	PROFILE_COUNTERS
+};
+
+// A fork/join pool, pool_run() hands the same job to every thread.
+typedef struct Pool_worker {
+	struct Pool *pool;
+	pthread_t thread;
 	int index;
-} Stack_control;
+	Arena arena; // scratch memory of the jobs this worker runs, kept for the next job
+	int profile_fd[PROFILE_COUNTERS]; // counters of this thread while a profile runs
+} Pool_worker;
+
+typedef struct Pool {
+	int threads;
+	Pool_worker *workers;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	uint64_t generation;
+	int pending;
+	bool quit;
+	bool pinned; // see pool_pin()
+	void (*job)(void *arg, int worker, int workers);
+	void *arg;
+} Pool;
+
+typedef struct Profile {
+	int fd[PROFILE_COUNTERS];        // -1 where the counter is not available
+	uint64_t count[PROFILE_COUNTERS];
+	Pool *pool;                      // running threads, they open counters of their own
+	bool incomplete[PROFILE_COUNTERS]; // a pool thread could not open the counter
+	Alloc_count alloc[ALLOC_SITES];  // allocations made during the run
+	double ms;
+} Profile;
+
+// A batch of independent mazes, next is the number of the next maze to generate.
+typedef struct Batch {
+	const Maze *config;
+	void (*generate)(Maze *m);
+	uint64_t count;
+	uint64_t next;
+	bool print_distances;
+	FILE *out;
+	FILE *stats;           // json line per maze, or NULL
+	pthread_mutex_t out_lock;
+} Batch;
+
+// Phases of making a maze, timed for --stats
+enum Phase {
+	PHASE_INITIALIZE,
+	PHASE_GENERATE,
+	PHASE_DISTANCES,
+	PHASE_PATH,
+	PHASE_TO_STRING,
+	PHASE_EXPORT,  // maze and image files
+	PHASES
+};
+
+typedef struct Maze_stats {
+	uint64_t number;       // maze number in a batch
+	const char *algorithm;
+	double ms[PHASES];
+	unsigned skipped;      // bit per Phase the maze did not go through, left out of the record
+	uint64_t max_distance;
+	uint64_t dead_ends;
+} Maze_stats;
 
 static const TPixel White = {255,255,255,255};
 static const TPixel Black = {0,0,0,255};
@@ -49,56 +268,107 @@ static const TPixel Blue = {0,0,255,255};
 static const TPixel Yellow = {255,255,0,255};
 static const TPixel Gray = {220,220,220,255};
 
-void initialize();
-void init_cell(Cell *c, int columns, int row);
-void configure_cells();
-Cell *cell(int column, int row);
-void link_cells(Cell *ca, Cell *cb, bool bi);
-bool unlink_cells(Cell *ca, Cell *cb, bool bi);
-bool linked(Cell *ca, Cell *cb);
-bool find_link(Cell *ca, Cell *cb);
-Cell **links(Cell *c);
-Cell **neighbors(Cell *c, int *counter);
-int neighbors_count(Cell *c);
-Cell *get_random_neighbor(Cell *c);
-Cell *get_random_neighbor_without_link(Cell *c);
-
-void binary_tree_maze();
-void sidewinder_maze();
-void aldous_broder_maze();
-void wilson_maze();
-void hunt_and_kill();
-void recursive_backtracker();
-
-void stack_push(Cell_node **stack, Cell_node *node);
-Cell_node *stack_pop(Cell_node **stack);
-
-bool array_includes_cell(Cell *arr[], Cell *c, int arr_len, int *index);
-int remove_cell_from_array(Cell *arr[], int cell_index, int length);
-Cell *calculate_distances(Cell *root);
-int dead_ends();
-
-int index_at(int col, int row);
-int row(int index);
-int column(int index);
-int size();
-Cell *random_cell_from_grid(int *index);
-Cell *random_cell_from_array(Cell **array, int length, int *index);
-void clear_maze_links();
-clock_t performance_test(void (*alg)(), int runs);
-//int stack_pop(Cell *arr[], int head);
-//int stack_push(Cell *arr[], Cell *c, int arr_len, int head);
-void push_stack(Stack_control **stack, void *data);
-void *pop_stack(Stack_control **stack);
-
-size_t get_maze_string_size();
-Cell **path_to(Cell *goal, int max_path);
-void to_string(char str_out[], size_t str_size, bool print_distances);
-void draw_start();
-void draw_update(int slow, Cell *focus);
-void draw_end();
-void draw(Cell **grid, Cell **breadcrumbs, int max_distance);
-TPixel color_grid_distance(Cell *cell, int max);
-
-void free_all();
+void initialize(Maze *m);
+uint64_t cell(Maze *m, uint64_t column, uint64_t row);
+uint64_t neighbor(Maze *m, uint64_t c, enum Direction d);
+uint8_t links(Maze *m, uint64_t c);
+bool linked_to(Maze *m, uint64_t c, enum Direction d);
+void link_direction(Maze *m, uint64_t c, enum Direction d);
+void unlink_direction(Maze *m, uint64_t c, enum Direction d);
+void link_cells(Maze *m, uint64_t ca, uint64_t cb);
+bool unlink_cells(Maze *m, uint64_t ca, uint64_t cb);
+bool linked(Maze *m, uint64_t ca, uint64_t cb);
+int links_count(Maze *m, uint64_t c);
+uint8_t neighbors_mask(Maze *m, uint64_t c);
+int neighbors(Maze *m, uint64_t c, uint64_t out[4]);
+int neighbors_unlinked(Maze *m, uint64_t c, uint64_t out[4]);
+int neighbors_count(Maze *m, uint64_t c);
+enum Direction random_direction_in(Maze *m, uint8_t mask);
+uint64_t get_random_neighbor(Maze *m, uint64_t c);
+enum Direction get_random_direction(Maze *m, uint64_t c);
+uint64_t get_random_neighbor_without_link(Maze *m, uint64_t c);
+
+void replay_links(Maze *m);
+void binary_tree_maze(Maze *m);
+void sidewinder_maze(Maze *m);
+void aldous_broder_maze(Maze *m);
+void wilson_maze(Maze *m);
+void hunt_and_kill(Maze *m);
+void recursive_backtracker(Maze *m);
+void eller_maze(Maze *m);
+void binary_tree_band(Maze *m, Rng *rng, uint64_t from, uint64_t to);
+void sidewinder_band(Maze *m, Rng *rng, uint64_t from, uint64_t to);
+void generate_maze(Maze *m, void (*generate)(Maze *m));
+
+void eller_start(Eller *eller, Arena *arena, uint64_t columns);
+void eller_row(Eller *eller, Rng *rng, bool last_row);
+
+void stack_push(Cell_stack *stack, uint64_t c);
+uint64_t stack_pop(Cell_stack *stack);
+
+uint64_t first_clear_bit(const uint64_t *bits, uint64_t from, uint64_t n);
+uint64_t remove_unvisited(uint64_t *unvisited, uint64_t *slot, uint64_t length, uint64_t c);
+uint64_t calculate_distances(Maze *m, uint64_t root);
+uint64_t calculate_distances_parallel(Maze *m, uint64_t root);
+uint64_t furthest_cell(Maze *m);
+uint64_t dead_ends(Maze *m);
+
+uint64_t index_at(Maze *m, uint64_t col, uint64_t row);
+uint64_t row(Maze *m, uint64_t index);
+uint64_t column(Maze *m, uint64_t index);
+uint64_t size(Maze *m);
+void rng_seed(Rng *r, uint64_t seed);
+uint64_t rng_next(Rng *r);
+void rng_jump(Rng *r);
+uint64_t rng_below(Rng *r, uint64_t n);
+uint64_t random_cell_from_grid(Maze *m, uint64_t *index);
+uint64_t random_cell_from_array(Maze *m, uint64_t *array, uint64_t length, uint64_t *index);
+void clear_maze_links(Maze *m);
+double performance_test(Maze *m, void (*alg)(Maze *m), int runs);
+void profile_start(Profile *p, Pool *pool);
+void profile_stop(Profile *p);
+void profile_algorithms(Maze *m, FILE *out);
+void batch_mazes(Maze *config, void (*generate)(Maze *m), uint64_t count, FILE *out, bool print_distances, FILE *stats);
+void write_stats(Maze *m, Maze_stats *s, FILE *out);
+double monotonic_ms(void);
+double lap_ms(double *since);
+const char *algorithm_name(void (*generate)(Maze *m));
+enum Page_mode page_mode(const char *name);
+const char *page_mode_name(Arena *a);
+
+
+void save_maze(Maze *m, const char *path, const char *algorithm, bool distances);
+bool load_maze(Maze *m, const char *path);
+void stream_eller(Maze *m, FILE *out, bool endless);
+size_t get_maze_string_size(Maze *m);
+uint64_t *path_to(Maze *m, uint64_t goal, uint64_t max_path);
+void to_string(Maze *m, FILE *out, bool print_distances);
+void draw_start(Maze *m);
+void draw_update(Maze *m, int slow, uint64_t focus);
+void draw_end(Maze *m);
+void draw(Maze *m, int max_distance);
+void save_image(Maze *m, const char *path, uint32_t max_distance, int cell_size);
+TPixel color_grid_distance(Maze *m, uint64_t cell, int max);
+
+Pool *pool_create(int threads);
+Pool *maze_pool(Maze *m);
+void pool_pin(Pool *pool);
+void pool_run(Pool *pool, void (*job)(void *arg, int worker, int workers), void *arg);
+void pool_free(Pool *pool);
+
+void *counted_malloc(enum Alloc_site site, size_t n);
+void *counted_calloc(enum Alloc_site site, size_t count, size_t n);
+void counted_free(enum Alloc_site site, void *p);
+void alloc_counts(Alloc_count out[ALLOC_SITES]);
+void *arena_alloc(Arena *a, enum Alloc_site site, size_t n);
+void *arena_calloc(Arena *a, enum Alloc_site site, size_t count, size_t n);
+Arena_mark arena_mark(Arena *a);
+void arena_release(Arena *a, Arena_mark mark);
+void arena_reset(Arena *a);
+void arena_free(Arena *a);
+size_t arena_size(Arena *a);
+
+
+void free_all(Maze *m);
+
 void die(char *e, int n);